@@ -0,0 +1,50 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#ifndef __CPU_BPRED_H__
+#define __CPU_BPRED_H__
+
+#include <common.h>
+
+#define BPRED_ENTRIES (1 << CONFIG_BPRED_TABLE_BITS)
+#define BPRED_MASK (BPRED_ENTRIES - 1)
+
+enum { BR_COND, BR_DIRECT, BR_INDIRECT, BR_RET };
+
+// a retired control transfer
+typedef struct {
+  vaddr_t pc;
+  vaddr_t snpc;   // the next sequential pc
+  vaddr_t target; // the next pc, equal to snpc if not taken
+  int kind;
+  bool taken;
+  bool call;
+} BranchInfo;
+
+/* A predictor model. predict_update() predicts the branch, then trains
+ * the model with the outcome. It returns whether the prediction is
+ * correct, or -1 if the model does not predict this kind of branches.
+ */
+typedef struct {
+  const char *name;
+  void (*init)();
+  int (*predict_update)(const BranchInfo *b);
+} BPredModel;
+
+void bpred_branch(const BranchInfo *b);
+void bpred_dump();
+
+#endif
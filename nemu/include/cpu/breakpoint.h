@@ -0,0 +1,41 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#ifndef __CPU_BREAKPOINT_H__
+#define __CPU_BREAKPOINT_H__
+
+#include <common.h>
+
+#define BP_FILTER_SIZE 4096
+
+/* The pc of every breakpoint is counted in a small hashed filter, so an
+ * instruction without a breakpoint only costs a load from the filter.
+ */
+extern uint8_t bp_filter[BP_FILTER_SIZE];
+extern vaddr_t bp_skip_pc; // the breakpoint where the execution stopped
+
+bool bp_check(vaddr_t pc);
+
+static inline uint32_t bp_hash(vaddr_t pc) {
+  return (pc >> 1) & (BP_FILTER_SIZE - 1);
+}
+
+// return true if the execution should stop before the instruction at `pc`
+static inline bool bp_hit(vaddr_t pc) {
+  return unlikely(bp_filter[bp_hash(pc)]) && bp_check(pc);
+}
+
+#endif
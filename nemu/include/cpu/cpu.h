@@ -19,7 +19,16 @@
 #include <common.h>
 
 void cpu_exec(uint64_t n);
+bool cpu_replay(uint64_t n);
+
+// how breakpoints and watchpoints act when they are hit
+enum { DEBUG_STOP, DEBUG_QUIET, DEBUG_OFF };
+extern int g_debug_mode;
+// set while cpu_replay() runs, the statistics and the outputs to the host
+// skip the replayed instructions
+extern bool g_replaying;
 void cpu_quit();
+uint64_t cpu_host_time();
 
 void set_nemu_state(int state, vaddr_t pc, int halt_ret);
 void invalid_inst(vaddr_t thispc);
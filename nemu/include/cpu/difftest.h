@@ -26,6 +26,13 @@ void difftest_set_patch(void (*fn)(void *arg), void *arg);
 void difftest_step(vaddr_t pc, vaddr_t npc);
 void difftest_detach();
 void difftest_attach();
+void difftest_sync();
+#ifdef CONFIG_DIFFTEST_BATCH
+void difftest_track_write(paddr_t addr, int len);
+#endif
+#ifdef CONFIG_DIFFTEST_BISECT
+void difftest_bisect();
+#endif
 #else
 static inline void difftest_skip_ref() {}
 static inline void difftest_skip_dut(int nr_ref, int nr_dut) {}
@@ -33,6 +40,7 @@ static inline void difftest_set_patch(void (*fn)(void *arg), void *arg) {}
 static inline void difftest_step(vaddr_t pc, vaddr_t npc) {}
 static inline void difftest_detach() {}
 static inline void difftest_attach() {}
+static inline void difftest_sync() {}
 #endif
 
 extern void (*ref_difftest_memcpy)(paddr_t addr, void *buf, size_t n, bool direction);
@@ -0,0 +1,50 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#ifndef __CPU_INST_STAT_H__
+#define __CPU_INST_STAT_H__
+
+#include <common.h>
+
+enum {
+  INST_ALU, INST_LOAD, INST_STORE, INST_BRANCH, INST_JUMP,
+  INST_MUL, INST_DIV, INST_SYSTEM, NR_INST_CLASS
+};
+
+// the counters of an instruction pattern
+typedef struct InstStat {
+  const char *name;
+  int cls;
+  uint64_t count;
+  uint64_t taken; // executions changing the control flow
+  struct InstStat *next;
+} InstStat;
+
+void inst_stat_register(InstStat *st, int cls);
+void inst_stat_dump();
+
+/* Count an execution of the pattern `opname`, after it is executed. The
+ * counters live at the pattern and are linked into the list at the first
+ * hit, so counting costs two increments without any lookup. `cls` is only
+ * evaluated at the first hit.
+ */
+#define INST_STAT(s, opname, cls) do { \
+  static InstStat __stat = { .name = str(opname) }; \
+  if (unlikely(__stat.count ++ == 0)) inst_stat_register(&__stat, cls); \
+  __stat.taken += ((s)->dnpc != (s)->snpc); \
+} while (0)
+
+#endif
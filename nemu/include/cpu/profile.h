@@ -0,0 +1,43 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#ifndef __CPU_PROFILE_H__
+#define __CPU_PROFILE_H__
+
+#include <common.h>
+
+#define PROFILE_MAX_DEPTH 64
+
+extern uint64_t profile_next; // g_nr_guest_inst at the next sample
+extern vaddr_t profile_stack[PROFILE_MAX_DEPTH];
+extern int profile_depth;
+
+void profile_sample(vaddr_t pc);
+void profile_dump();
+
+/* The shadow call stack, maintained by the ISA at calls and returns. The
+ * bottom is the entry of the program and never returns. Frames deeper than PROFILE_MAX_DEPTH are counted but not recorded.
+ */
+static inline void profile_call(vaddr_t target) {
+  if (profile_depth < PROFILE_MAX_DEPTH) profile_stack[profile_depth] = target;
+  profile_depth ++;
+}
+
+static inline void profile_ret() {
+  if (profile_depth > 1) profile_depth --;
+}
+
+#endif
@@ -0,0 +1,42 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#ifndef __CPU_REVERSE_H__
+#define __CPU_REVERSE_H__
+
+#include <common.h>
+
+extern uint64_t g_nr_guest_inst;
+extern uint64_t reverse_next_snapshot;
+
+void reverse_take_snapshot();
+
+// called after every instruction
+static inline void reverse_step_hook() {
+  if (unlikely(g_nr_guest_inst == reverse_next_snapshot)) reverse_take_snapshot();
+}
+
+/* The inputs from input_log() are logged while running forward, and the
+ * logged ones are returned when the same instructions are replayed after
+ * going back.
+ */
+bool reverse_replay_input(uint64_t *val);
+void reverse_log_input(uint64_t val);
+
+void reverse_step(uint64_t n);
+bool reverse_continue();
+
+#endif
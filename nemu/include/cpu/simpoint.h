@@ -0,0 +1,38 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#ifndef __CPU_SIMPOINT_H__
+#define __CPU_SIMPOINT_H__
+
+#include <cpu/decode.h>
+
+extern uint64_t g_nr_guest_inst;
+extern bool simpoint_bbv_enable;
+extern uint64_t simpoint_next_event;
+
+void simpoint_end_block(vaddr_t next_pc);
+void simpoint_event();
+void simpoint_finish();
+
+/* Called after every instruction. The basic block vector is only updated
+ * at the end of a block, i.e. when the control flow is transferred.
+ */
+static inline void simpoint_step(Decode *s) {
+  if (simpoint_bbv_enable && s->dnpc != s->snpc) simpoint_end_block(s->dnpc);
+  if (unlikely(g_nr_guest_inst == simpoint_next_event)) simpoint_event();
+}
+
+#endif
@@ -0,0 +1,52 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#ifndef __CPU_TIMING_H__
+#define __CPU_TIMING_H__
+
+#include <common.h>
+#include <cpu/inst-stat.h>
+
+#ifdef CONFIG_TIMING
+
+// the causes of the cycles
+enum { TIMING_ISSUE, TIMING_LOAD_USE, TIMING_BRANCH, TIMING_CACHE, NR_TIMING_CAUSE };
+
+extern uint64_t timing_cycles[NR_TIMING_CAUSE];
+extern const uint16_t timing_latency[NR_INST_CLASS];
+extern uint64_t timing_nr_load_use;
+extern int timing_load_rd;
+
+void timing_branch_miss();
+void timing_cache_miss(bool to_memory);
+void timing_dump();
+
+/* Account an instruction of class `cls`, reading `rs1` and `rs2` and
+ * writing `rd`. Pass 0 for the registers it does not use. The result of a
+ * load is available one instruction later, and using it earlier stalls.
+ */
+static inline void timing_inst(int cls, int rd, int rs1, int rs2) {
+  timing_cycles[TIMING_ISSUE] += timing_latency[cls];
+  if (timing_load_rd != 0 && (rs1 == timing_load_rd || rs2 == timing_load_rd)) {
+    timing_cycles[TIMING_LOAD_USE] += CONFIG_TIMING_LOAD_USE_STALL;
+    timing_nr_load_use ++;
+  }
+  timing_load_rd = (cls == INST_LOAD ? rd : 0);
+}
+
+#endif
+
+#endif
@@ -0,0 +1,54 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#ifndef __CPU_WATCHPOINT_H__
+#define __CPU_WATCHPOINT_H__
+
+#include <common.h>
+#include <memory/vaddr.h>
+
+#define WP_NR_PAGE (CONFIG_MSIZE >> PAGE_SHIFT)
+
+/* Watchpoints are only evaluated when the state they read may have been
+ * changed, i.e. a store to a watched address or a write to a watched
+ * register. Expressions which can not be analyzed (such as `*$sp`) set
+ * `wp_poll`, and all watchpoints are evaluated after every instruction.
+ */
+extern bool wp_triggered;
+extern bool wp_poll;
+extern uint64_t wp_reg_mask;
+extern uint16_t wp_page[WP_NR_PAGE];
+
+bool check_watchpoints();
+void wp_check_write(paddr_t addr, int len);
+
+// called before every store to pmem
+static inline void wp_track_write(paddr_t addr, int len) {
+  uint32_t pg = (addr - CONFIG_MBASE) >> PAGE_SHIFT;
+  uint32_t pg_end = (addr + len - 1 - CONFIG_MBASE) >> PAGE_SHIFT;
+  if (unlikely(wp_page[pg] | wp_page[pg_end])) wp_check_write(addr, len);
+}
+
+// called by the decoder when the general purpose register `idx` is written
+static inline void wp_track_reg(int idx) {
+  if (unlikely((wp_reg_mask >> idx) & 1)) wp_triggered = true;
+}
+
+static inline bool wp_need_check() {
+  return unlikely(wp_triggered | wp_poll);
+}
+
+#endif
@@ -28,6 +28,11 @@ typedef struct {
   paddr_t high;
   void *space;
   io_callback_t callback;
+  int id; // the index in all maps
+#ifdef CONFIG_DEVICE_STAT
+  uint64_t nr_read, nr_write, bytes;
+  uint64_t callback_ns;
+#endif
 } IOMap;
 
 static inline bool map_inside(IOMap *map, paddr_t addr) {
@@ -50,7 +55,13 @@ void add_pio_map(const char *name, ioaddr_t addr,
 void add_mmio_map(const char *name, paddr_t addr,
         void *space, uint32_t len, io_callback_t callback);
 
+void map_register(IOMap *map);
 word_t map_read(paddr_t addr, int len, IOMap *map);
 void map_write(paddr_t addr, int len, word_t data, IOMap *map);
 
+#ifdef CONFIG_DEVICE_STAT
+uint64_t map_host_ns();
+void device_stat_dump();
+#endif
+
 #endif
@@ -12,9 +12,12 @@ typedef struct {
     Elf32_Word size;
 } FunctionInfo;
 
-extern FunctionInfo functions[128];
+#define MAX_FUNCTIONS 1024
+
+extern FunctionInfo functions[MAX_FUNCTIONS];
 extern uint32_t num_functions;
 
 void load_elf(const char* elf_file, FunctionInfo* functions, uint32_t* num_functions);
+int find_function(Elf32_Addr addr);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,45 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#ifndef __MEMORY_CACHE_H__
+#define __MEMORY_CACHE_H__
+
+#include <common.h>
+
+#ifdef CONFIG_CACHE_SIM
+
+#define CACHE_LINE_SHIFT __builtin_ctz(CONFIG_CACHE_LINE_SIZE)
+
+extern uint64_t cache_last_iblock;
+extern uint64_t cache_ifetch_batched;
+
+void cache_ifetch_block(uint64_t block);
+void cache_data(paddr_t addr, int len, bool is_write);
+void cache_dump();
+
+/* Consecutive fetches from the same line must hit in L1I, since only
+ * fetches touch L1I. They are only counted here, and accounted in a batch
+ * when the control flow leaves the line.
+ */
+static inline void cache_ifetch(paddr_t addr) {
+  uint64_t block = addr >> CACHE_LINE_SHIFT;
+  if (likely(block == cache_last_iblock)) cache_ifetch_batched ++;
+  else cache_ifetch_block(block);
+}
+
+#endif
+
+#endif
@@ -0,0 +1,50 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#ifndef __MEMORY_CHECKPOINT_H__
+#define __MEMORY_CHECKPOINT_H__
+
+#include <common.h>
+
+/* Layout of a checkpoint file:
+ *   CheckpointHeader
+ *   CPU_state                       at `cpu_offset`
+ *   DevRecord of every device state at `dev_offset`
+ *   raw image of pmem               at `mem_offset`, aligned to a page
+ * Pages of pmem filled with zero are left as holes in the file, and the
+ * image is mapped with MAP_PRIVATE when restoring, so only the pages
+ * touched by the guest are read from the disk.
+ */
+
+#define CKPT_MAGIC   0x54504b43554d454eull // "NEMUCKPT"
+#define CKPT_VERSION 2
+
+typedef struct {
+  uint64_t magic;
+  uint32_t version;
+  char isa[16];
+  uint64_t mbase;
+  uint64_t msize;
+  uint64_t nr_inst;
+  uint64_t cpu_offset, cpu_size;
+  uint64_t dev_offset, dev_size;
+  uint64_t mem_offset;
+} CheckpointHeader;
+
+void checkpoint_save(const char *file);
+long checkpoint_restore(const char *file);
+
+#endif
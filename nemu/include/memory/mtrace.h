@@ -0,0 +1,51 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#ifndef __MEMORY_MTRACE_H__
+#define __MEMORY_MTRACE_H__
+
+#include <common.h>
+
+#ifdef CONFIG_MTRACE
+
+enum { MTRACE_READ = 1, MTRACE_WRITE = 2, MTRACE_FETCH = 4 };
+
+/* A record in the trace file. The file starts with MTRACE_MAGIC and a
+ * byte of sizeof(word_t), followed by the records.
+ */
+#define MTRACE_MAGIC "NEMUMTR1"
+
+typedef struct __attribute__((packed)) {
+  word_t pc;
+  word_t addr;
+  word_t data;
+  uint8_t len_type; // len | type << 4
+} MTraceRecord;
+
+extern int mtrace_type; // the types of accesses being traced, 0 if the trace is off
+
+void mtrace_record(int type, vaddr_t addr, int len, word_t data);
+bool mtrace_set_filter(char *spec);
+void mtrace_enable(bool enable);
+void mtrace_info();
+
+static inline void mtrace_access(int type, vaddr_t addr, int len, word_t data) {
+  if (unlikely(mtrace_type & type)) mtrace_record(type, addr, len, data);
+}
+
+#endif
+
+#endif
@@ -31,6 +31,9 @@ static inline bool in_pmem(paddr_t addr) {
   return addr - CONFIG_MBASE < CONFIG_MSIZE;
 }
 
+/* map pmem to the memory image in a file, pages are loaded when touched */
+void pmem_map(int fd, long offset);
+
 word_t paddr_read(paddr_t addr, int len);
 void paddr_write(paddr_t addr, int len, word_t data);
 
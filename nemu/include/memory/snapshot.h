@@ -0,0 +1,82 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#ifndef __MEMORY_SNAPSHOT_H__
+#define __MEMORY_SNAPSHOT_H__
+
+#include <common.h>
+#include <memory/vaddr.h>
+
+#define NR_SNAPSHOT 8
+#define NR_USER_SNAPSHOT (NR_SNAPSHOT / 2)
+
+/* Snapshots are numbered from 0 (the oldest) to snapshot_count() - 1 (the
+ * latest). Taking a snapshot when all slots are used drops the oldest one
+ * which is not taken by the user, e.g. by `save`. At most NR_USER_SNAPSHOT
+ * of the latter are kept, and taking one more returns -1. Restoring a
+ * snapshot drops all snapshots newer than it.
+ */
+int snapshot_take(bool user);
+void snapshot_restore(int idx);
+int snapshot_count();
+uint64_t snapshot_nr_inst(int idx);
+
+/* Devices register the memory holding their states under unique names before
+ * any snapshot is taken. The memory is copied when a snapshot is taken, and written back
+ * when it is restored. A device may also register callbacks: `save` is
+ * called before the memory is copied, and `restore` after it is written
+ * back, to adjust the states outside NEMU, such as the position of a file.
+ * Either of them can be NULL.
+ */
+typedef void (*snapshot_callback_t)();
+void snapshot_add_state(const char *name, void *state, size_t size);
+// the states of the tools in NEMU, e.g. the profiler, are not in checkpoints
+void snapshot_add_tool_state(const char *name, void *state, size_t size);
+void snapshot_add_callback(snapshot_callback_t save, snapshot_callback_t restore);
+size_t snapshot_dev_size();
+void snapshot_dev_save(uint8_t *buf);
+void snapshot_dev_load(const uint8_t *buf);
+
+/* In a checkpoint, every device state is a record with its name and size,
+ * so that a build with other devices can skip the unknown states instead
+ * of loading them into the wrong fields.
+ */
+typedef struct {
+  char name[24];
+  uint64_t size;
+} DevRecord;
+size_t snapshot_dev_record_size();
+void snapshot_dev_save_records(uint8_t *buf);
+void snapshot_dev_load_records(const uint8_t *buf, size_t size);
+
+// --- copy-on-write of pmem ---
+
+#define SNAPSHOT_NR_PAGE (CONFIG_MSIZE >> PAGE_SHIFT)
+
+extern uint32_t snapshot_epoch;
+extern uint32_t snapshot_page_epoch[SNAPSHOT_NR_PAGE];
+void snapshot_save_page(uint32_t pg);
+
+/* Called before every store to pmem. A page is saved when it is written for
+ * the first time after the latest snapshot is taken.
+ */
+static inline void snapshot_track_write(paddr_t addr, int len) {
+  uint32_t pg = (addr - CONFIG_MBASE) >> PAGE_SHIFT;
+  uint32_t pg_end = (addr + len - 1 - CONFIG_MBASE) >> PAGE_SHIFT;
+  if (unlikely(snapshot_page_epoch[pg] != snapshot_epoch)) snapshot_save_page(pg);
+  if (unlikely(snapshot_page_epoch[pg_end] != snapshot_epoch)) snapshot_save_page(pg_end);
+}
+
+#endif
@@ -34,6 +34,74 @@ extern NEMUState nemu_state;
 
 uint64_t get_time();
 
+// ----------- record and replay -----------
+
+// values from the host which are visible to the guest
+enum { INPUT_SEED, INPUT_RTC, INPUT_KEY, NR_INPUT_TYPE };
+
+// `host_input` is only called when the value is not replayed
+uint64_t input_log(int type, uint64_t (*host_input)());
+
+// ----------- host performance counters -----------
+
+// the phases of NEMU itself, where PERF_RUN counts what is left in the main loop
+enum { PERF_RUN, PERF_EXEC, PERF_DECODE, PERF_PADDR, PERF_MMIO, PERF_DEVICE,
+  PERF_TRACE, PERF_DIFFTEST, PERF_LOG, NR_PERF };
+
+#ifdef CONFIG_HOST_PERF
+#define PERF_MAX_DEPTH 16
+
+extern struct PerfFrame { int phase; uint64_t start, child; } perf_stack[PERF_MAX_DEPTH];
+extern int perf_depth;
+extern bool perf_sampled;
+extern uint64_t perf_seed;
+extern uint64_t perf_count[NR_PERF];
+
+uint64_t perf_clock_ns();
+void perf_end_timed(struct PerfFrame *f, uint64_t now);
+void perf_dump();
+
+static inline uint64_t perf_now() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __builtin_ia32_rdtsc();
+#else
+  return perf_clock_ns();
+#endif
+}
+
+/* The phases nest, e.g. the accesses to the memory happen in PERF_EXEC.
+ * The calls of the phases in PERF_RUN are all counted, but only one in
+ * CONFIG_HOST_PERF_SAMPLE of them at random, together with the phases
+ * nested in it, is timed, since reading the clock costs more than some of
+ * the phases. The choice is random, so that a phase entered at several
+ * places in turn is sampled evenly.
+ */
+static inline void perf_begin(int phase) {
+  int d = perf_depth ++;
+  if (d == 1) {
+    perf_seed = perf_seed * 6364136223846793005ull + 1442695040888963407ull;
+    perf_sampled = ((perf_seed >> 32) < 0x100000000ull / CONFIG_HOST_PERF_SAMPLE);
+  }
+  if (d > 0) perf_count[phase] ++;
+  if (d > 0 && !perf_sampled) return;
+  struct PerfFrame *f = &perf_stack[d];
+  f->phase = phase;
+  f->child = 0;
+  f->start = perf_now();
+}
+
+static inline void perf_end() {
+  int d = -- perf_depth;
+  if (d > 0 && !perf_sampled) return;
+  perf_end_timed(&perf_stack[d], perf_now());
+}
+#endif
+
+#define PERF_BEGIN(phase) IFDEF(CONFIG_HOST_PERF, perf_begin(phase))
+#define PERF_END() IFDEF(CONFIG_HOST_PERF, perf_end())
+// run the statements in `phase`
+#define PERF(phase, ...) do { PERF_BEGIN(phase); __VA_ARGS__; PERF_END(); } while (0)
+
 // ----------- log -----------
 
 #define ANSI_FG_BLACK   "\33[1;30m"
@@ -61,8 +129,7 @@ uint64_t get_time();
     extern FILE* log_fp; \
     extern bool log_enable(); \
     if (log_enable()) { \
-      fprintf(log_fp, __VA_ARGS__); \
-      fflush(log_fp); \
+      PERF(PERF_LOG, fprintf(log_fp, __VA_ARGS__); fflush(log_fp)); \
     } \
   } while (0) \
 )
@@ -0,0 +1,115 @@
+#***************************************************************************************
+# Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+#
+# NEMU is licensed under Mulan PSL v2.
+# You can use this software according to the terms and conditions of the Mulan PSL v2.
+# You may obtain a copy of Mulan PSL v2 at:
+#          http://license.coscl.org.cn/MulanPSL2
+#
+# THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+# EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+# MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+#
+# See the Mulan PSL v2 for more details.
+#**************************************************************************************/
+
+
+# Benchmark NEMU on the guest workloads in tools/bench. Every workload is
+# run BENCH_REPEAT times in batch mode, the fastest run is kept, and the
+# results are written to BENCH_OUT as JSON, one workload per line.
+#   make bench                                  build the workloads with AM and run them
+#   make bench BENCH_IMGS="a.bin b.bin"         run prebuilt images instead
+#   make bench BENCH_BASELINE=old.json          also fail on throughput regressions
+
+BENCH_HOME      = $(NEMU_HOME)/tools/bench
+BENCH_ARCH     ?= $(GUEST_ISA)-nemu
+BENCH_LIST     ?= intcpu memcpy fbwrite branch
+BENCH_REPEAT   ?= 3
+BENCH_DIR       = $(BUILD_DIR)/bench
+BENCH_OUT      ?= $(BUILD_DIR)/bench.json
+BENCH_BASELINE ?=
+# the largest drop of MIPS (in percent) not reported as a regression
+BENCH_TOLERANCE ?= 5
+
+ifeq ($(origin BENCH_IMGS), undefined)
+BENCH_IMGS = $(foreach w,$(BENCH_LIST),$(BENCH_HOME)/$(w)/build/$(w)-$(BENCH_ARCH).bin)
+bench-images:
+	$(if $(AM_HOME),,$(error $$AM_HOME is required to build the workloads, or set BENCH_IMGS))
+	@$(foreach w,$(BENCH_LIST),$(MAKE) -s -C $(BENCH_HOME)/$(w) ARCH=$(BENCH_ARCH) image &&) true
+else
+bench-images:
+endif
+
+# `statistic()` prints numbers with thousands separators in some locales
+BENCH_PARSE = '{ gsub(/\033\[[0-9;]*m/, ""); v = $$0; sub(/.*= /, "", v); gsub(/[^0-9]/, "", v) } \
+  /host time spent =/ { us = v } /total guest instructions =/ { inst = v } \
+  END { print (inst == "" ? 0 : inst), (us == "" ? 0 : us) }'
+
+BENCH_JSON = '{ mips = ($$4 > 0 ? $$3 / $$4 : 0); \
+  w[NR] = sprintf("    {\"name\": \"%s\", \"image\": \"%s\", \"status\": %d, \"instructions\": %s, \"host_us\": %s, \"mips\": %.2f}", \
+    $$1, $$5, $$2, $$3, $$4, mips) } \
+  END { printf("{\n  \"commit\": \"%s\",\n  \"date\": \"%s\",\n  \"repeat\": %d,\n  \"workloads\": [\n", commit, date, repeat); \
+    for (i = 1; i <= NR; i ++) printf("%s%s\n", w[i], (i < NR ? "," : "")); \
+    printf("  ]\n}\n") }'
+
+BENCH_COMPARE = 'function field(k) { return (match($$0, "\"" k "\": \"?[^,\"}]*") ? \
+    substr($$0, RSTART + length(k) + 4, RLENGTH - length(k) - 4) : "") } \
+  /"name":/ { n = field("name"); sub(/^"/, "", n); m = field("mips") + 0; \
+    if (FILENAME == base) old[n] = m; else { new[n] = m; order[++ nr] = n } } \
+  END { bad = 0; printf("%-12s %10s %10s %8s\n", "workload", "base", "MIPS", "change"); \
+    for (i = 1; i <= nr; i ++) { n = order[i]; \
+      if (!(n in old) || old[n] == 0) { printf("%-12s %10s %10.2f\n", n, "-", new[n]); continue } \
+      d = 100 * (new[n] - old[n]) / old[n]; \
+      printf("%-12s %10.2f %10.2f %+7.1f%%%s\n", n, old[n], new[n], d, (d < -tol ? "  REGRESSION" : "")); \
+      if (d < -tol) bad = 1 } \
+    exit bad }'
+
+bench: $(BINARY) $(DIFF_REF_SO) bench-images
+	@mkdir -p $(BENCH_DIR)
+	@rm -f $(BENCH_DIR)/results.txt
+	@for img in $(BENCH_IMGS); do \
+	  name=`basename $$img .bin | sed 's/-$(BENCH_ARCH)$$//'`; best=""; \
+	  i=0; while [ $$i -lt $(BENCH_REPEAT) ]; do \
+	    $(BINARY) -b $(ARGS_DIFF) $$img > $(BENCH_DIR)/$$name.log 2>&1; status=$$?; \
+	    set -- `awk $(BENCH_PARSE) $(BENCH_DIR)/$$name.log`; \
+	    if [ $$status -ne 0 ] || [ $$2 -eq 0 ]; then best="$$status 0 0"; break; fi; \
+	    if [ -z "$$best" ] || [ $$2 -lt `echo $$best | cut -d' ' -f3` ]; then best="0 $$1 $$2"; fi; \
+	    i=`expr $$i + 1`; \
+	  done; \
+	  echo "$$name $$best $$img" >> $(BENCH_DIR)/results.txt; \
+	  set -- $$best; \
+	  if [ $$1 -ne 0 ] || [ $$3 -eq 0 ]; then echo "$$name: FAILED, see $(BENCH_DIR)/$$name.log"; \
+	  else awk -v n=$$name -v inst=$$2 -v us=$$3 'BEGIN { printf("%s: %.2f MIPS (%s instructions in %s us)\n", n, inst / us, inst, us) }'; fi; \
+	done
+	@awk -v commit="`git -C $(NEMU_HOME) rev-parse --short HEAD 2>/dev/null`" -v date="`date -u +%FT%TZ`" \
+	  -v repeat=$(BENCH_REPEAT) $(BENCH_JSON) $(BENCH_DIR)/results.txt > $(BENCH_OUT)
+	@echo "results written to $(BENCH_OUT)"
+	$(if $(BENCH_BASELINE),@awk -v base=$(BENCH_BASELINE) -v tol=$(BENCH_TOLERANCE) $(BENCH_COMPARE) $(BENCH_BASELINE) $(BENCH_OUT))
+	@awk '$$2 != 0 || $$4 == 0 { bad = 1 } END { exit bad }' $(BENCH_DIR)/results.txt || { echo "some workloads failed"; false; }
+
+# The workloads are also the training set of PGO (see scripts/build.mk).
+# A failed run still contributes its profile, so it only warns.
+PGO_IMGS ?= $(BENCH_IMGS)
+
+pgo-train: $(BINARY) $(DIFF_REF_SO) $(if $(filter file undefined,$(origin PGO_IMGS)),bench-images)
+	@$(foreach img,$(PGO_IMGS),echo + TRAIN $(img); \
+	  $(BINARY) -b $(ARGS_DIFF) $(img) > /dev/null 2>&1 || echo "warning: $(img) failed";)
+
+# Microbenchmarks of the primitives of the interpreter, linked with the
+# objects of NEMU in place of nemu-main.c
+MICROBENCH      = $(BUILD_DIR)/$(NAME)-microbench
+MICROBENCH_OBJS = $(filter-out $(OBJ_DIR)/src/nemu-main.o,$(OBJS)) $(OBJ_DIR)/src/microbench.o
+-include $(OBJ_DIR)/src/microbench.d
+
+$(MICROBENCH): $(MICROBENCH_OBJS) $(ARCHIVES)
+	@echo + LD $@
+	@$(LD) -o $@ $(MICROBENCH_OBJS) $(LDFLAGS) $(ARCHIVES) $(LIBS)
+
+microbench: $(MICROBENCH) $(DIFF_REF_SO)
+	$(MICROBENCH) $(ARGS) $(IMG)
+
+clean-bench:
+	-rm -rf $(BENCH_DIR) $(BENCH_OUT) $(addsuffix /build,$(addprefix $(BENCH_HOME)/,$(BENCH_LIST)))
+clean-all: clean-bench
+
+.PHONY: bench bench-images pgo-train microbench clean-bench
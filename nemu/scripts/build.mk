@@ -10,9 +10,17 @@ endif
 WORK_DIR  = $(shell pwd)
 BUILD_DIR = $(WORK_DIR)/build
 
+# Profile-guided optimization: PGO=gen builds an instrumented binary,
+# and PGO=use builds with the profile collected by it. Both use the same
+# object directory, since GCC finds the profile of an object by its path.
+ifneq ($(PGO),)
+PGO_SUFFIX = -pgo
+endif
+PGO_DIR  = $(BUILD_DIR)/pgo-$(NAME)$(SO)
+
 INC_PATH := $(WORK_DIR)/include $(INC_PATH)
-OBJ_DIR  = $(BUILD_DIR)/obj-$(NAME)$(SO)
-BINARY   = $(BUILD_DIR)/$(NAME)$(SO)
+OBJ_DIR  = $(BUILD_DIR)/obj-$(NAME)$(SO)$(PGO_SUFFIX)
+BINARY   = $(BUILD_DIR)/$(NAME)$(SO)$(PGO_SUFFIX)
 
 # Compilation flags
 ifeq ($(CC),clang)
@@ -25,6 +33,20 @@ INCLUDES = $(addprefix -I, $(INC_PATH))
 CFLAGS  := -O2 -MMD -Wall -Werror $(INCLUDES) $(CFLAGS)
 LDFLAGS := -O2 $(LDFLAGS)
 
+ifeq ($(PGO),gen)
+CFLAGS  += -fprofile-generate=$(PGO_DIR)
+LDFLAGS += -fprofile-generate=$(PGO_DIR)
+else ifeq ($(PGO),use)
+ifeq ($(CC),clang)
+CFLAGS  += -fprofile-use=$(PGO_DIR)/default.profdata -Wno-profile-instr-unprofiled
+LDFLAGS += -fprofile-use=$(PGO_DIR)/default.profdata
+else
+# code not covered by the training is optimized as usual
+CFLAGS  += -fprofile-use=$(PGO_DIR) -fprofile-partial-training -Wno-missing-profile
+LDFLAGS += -fprofile-use=$(PGO_DIR) -fprofile-partial-training
+endif
+endif
+
 OBJS = $(SRCS:%.c=$(OBJ_DIR)/%.o) $(CXXSRC:%.cc=$(OBJ_DIR)/%.o)
 
 # Compilation patterns
@@ -45,7 +67,7 @@ $(OBJ_DIR)/%.o: %.cc
 
 # Some convenient rules
 
-.PHONY: app clean
+.PHONY: app pgo clean
 
 app: $(BINARY)
 
@@ -53,5 +75,17 @@ $(BINARY): $(OBJS) $(ARCHIVES)
 	@echo + LD $@
 	@$(LD) -o $@ $(OBJS) $(LDFLAGS) $(ARCHIVES) $(LIBS)
 
+# Build with PGO in one step. The includer provides `pgo-train`, which
+# runs the instrumented $(BINARY) on the training set.
+pgo:
+	-@rm -rf $(PGO_DIR) $(BUILD_DIR)/obj-$(NAME)$(SO)-pgo
+	@$(MAKE) PGO=gen app
+	@$(MAKE) PGO=gen pgo-train
+ifeq ($(CC),clang)
+	llvm-profdata merge -output=$(PGO_DIR)/default.profdata $(PGO_DIR)/*.profraw
+endif
+	-@rm -rf $(BUILD_DIR)/obj-$(NAME)$(SO)-pgo
+	@$(MAKE) PGO=use app
+
 clean:
 	-rm -rf $(BUILD_DIR)
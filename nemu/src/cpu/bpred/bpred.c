@@ -0,0 +1,181 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <cpu/cpu.h>
+#include <cpu/bpred.h>
+#include <cpu/timing.h>
+#ifdef CONFIG_ELF_SYMBOLS
+#include <ftrace.h>
+#endif
+
+extern uint64_t g_nr_guest_inst;
+
+/* All models are evaluated against the same stream of branches in one
+ * run. Add a model by appending it to `models`.
+ */
+
+extern BPredModel bpred_bimodal, bpred_gshare, bpred_tage, bpred_btb, bpred_ras;
+
+static BPredModel *models[] = {
+  &bpred_bimodal, &bpred_gshare, &bpred_tage, &bpred_btb, &bpred_ras,
+};
+
+#define NR_MODEL ARRLEN(models)
+#define TOP_N 10
+
+typedef struct {
+  vaddr_t pc;
+  uint64_t count[NR_MODEL], miss[NR_MODEL];
+  bool used;
+} PCStat;
+
+static uint64_t count[NR_MODEL] = {}, miss[NR_MODEL] = {};
+static uint64_t nr_branch = 0;
+
+#ifdef CONFIG_TIMING
+// the models predicting the branches of the timing model
+static int timing_dir = -1, timing_btb = -1, timing_ras = -1;
+#endif
+
+static PCStat *pc_table = NULL; // open addressing
+static uint32_t pc_mask = 0, nr_pc = 0;
+
+static inline uint32_t hash_pc(vaddr_t pc) {
+  return (uint32_t)((pc >> 1) * 0x9e3779b1u);
+}
+
+static PCStat *pc_lookup(PCStat *table, uint32_t mask, vaddr_t pc) {
+  uint32_t i;
+  for (i = hash_pc(pc) & mask; table[i].used && table[i].pc != pc; i = (i + 1) & mask);
+  return &table[i];
+}
+
+static void pc_grow() {
+  PCStat *old = pc_table;
+  uint32_t old_size = (old == NULL ? 0 : pc_mask + 1);
+  uint32_t size = (old == NULL ? 1024 : old_size * 2), i;
+
+  pc_table = calloc(size, sizeof(pc_table[0]));
+  assert(pc_table);
+  pc_mask = size - 1;
+  for (i = 0; i < old_size; i ++) {
+    if (old[i].used) *pc_lookup(pc_table, pc_mask, old[i].pc) = old[i];
+  }
+  free(old);
+}
+
+void bpred_branch(const BranchInfo *b) {
+  if ((nr_pc + 1) * 2 > pc_mask + 1) pc_grow();
+  PCStat *ps = pc_lookup(pc_table, pc_mask, b->pc);
+  if (!ps->used) {
+    ps->pc = b->pc;
+    ps->used = true;
+    nr_pc ++;
+  }
+
+  nr_branch ++;
+  int correct[NR_MODEL];
+  int i;
+  for (i = 0; i < NR_MODEL; i ++) {
+    correct[i] = models[i]->predict_update(b);
+    if (correct[i] < 0) continue;
+    count[i] ++;
+    ps->count[i] ++;
+    if (!correct[i]) {
+      miss[i] ++;
+      ps->miss[i] ++;
+    }
+  }
+
+#ifdef CONFIG_TIMING
+  // a taken branch needs both the direction and the target, and no prediction is a miss
+  bool ok = (b->kind == BR_RET ? correct[timing_ras] > 0 :
+      ((b->kind != BR_COND || correct[timing_dir] > 0) && (!b->taken || correct[timing_btb] > 0)));
+  if (!ok) timing_branch_miss();
+#endif
+}
+
+#ifdef CONFIG_TIMING
+static int find_model(const char *name) {
+  int i;
+  for (i = 0; i < NR_MODEL; i ++) {
+    if (strcmp(models[i]->name, name) == 0) return i;
+  }
+  panic("no branch predictor named '%s'", name);
+}
+#endif
+
+void init_bpred() {
+  int i;
+  for (i = 0; i < NR_MODEL; i ++) models[i]->init();
+  pc_grow();
+#ifdef CONFIG_TIMING
+  timing_dir = find_model(CONFIG_TIMING_BPRED_MODEL);
+  timing_btb = find_model("btb");
+  timing_ras = find_model("ras");
+#endif
+}
+
+static int cur_model = 0;
+
+static int cmp_miss(const void *a, const void *b) {
+  uint64_t x = (*(PCStat **)a)->miss[cur_model], y = (*(PCStat **)b)->miss[cur_model];
+  return (x < y) - (x > y);
+}
+
+static inline double rate(uint64_t x, uint64_t total) {
+  return (total == 0 ? 0 : 100.0 * x / total);
+}
+
+static const char *symbol(vaddr_t pc) {
+#ifdef CONFIG_ELF_SYMBOLS
+  int f = find_function(pc);
+  if (f >= 0) return functions[f].name;
+#endif
+  return "";
+}
+
+void bpred_dump() {
+  PCStat **list = malloc(sizeof(list[0]) * (nr_pc + 1));
+  uint32_t i, n = 0;
+  int m;
+
+  assert(list);
+  for (i = 0; i <= pc_mask && pc_table != NULL; i ++) {
+    if (pc_table[i].used) list[n ++] = &pc_table[i];
+  }
+
+  Log("branch predictors: %" PRIu64 " control transfers in %" PRIu64 " instructions",
+      nr_branch, g_nr_guest_inst);
+  _Log("  %-8s %16s %14s %8s %8s\n", "model", "predicted", "mispredicted", "miss%", "MPKI");
+  for (m = 0; m < NR_MODEL; m ++) {
+    _Log("  %-8s %16" PRIu64 " %14" PRIu64 " %8.2f %8.3f\n", models[m]->name, count[m], miss[m],
+        rate(miss[m], count[m]), (g_nr_guest_inst == 0 ? 0 : 1000.0 * miss[m] / g_nr_guest_inst));
+  }
+
+  for (m = 0; m < NR_MODEL; m ++) {
+    if (miss[m] == 0) continue;
+    cur_model = m;
+    qsort(list, n, sizeof(list[0]), cmp_miss);
+    Log("most mispredicted pcs of %s:", models[m]->name);
+    for (i = 0; i < TOP_N && i < n && list[i]->miss[m] != 0; i ++) {
+      PCStat *ps = list[i];
+      _Log("  " FMT_WORD " %14" PRIu64 " %14" PRIu64 " %8.2f  %s\n", ps->pc, ps->count[m],
+          ps->miss[m], rate(ps->miss[m], ps->count[m]), symbol(ps->pc));
+    }
+  }
+  free(list);
+}
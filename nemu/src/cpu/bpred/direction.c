@@ -0,0 +1,69 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <cpu/bpred.h>
+
+// Direction predictors with 2-bit saturating counters.
+
+static inline bool ctr_taken(uint8_t c) {
+  return c >= 2;
+}
+
+static inline void ctr_update(uint8_t *c, bool taken) {
+  if (taken) { if (*c < 3) (*c) ++; }
+  else if (*c > 0) (*c) --;
+}
+
+// indexed by the pc
+static uint8_t bimodal[BPRED_ENTRIES];
+
+static void bimodal_init() {
+  memset(bimodal, 1, sizeof(bimodal));
+}
+
+static int bimodal_predict_update(const BranchInfo *b) {
+  if (b->kind != BR_COND) return -1;
+  uint8_t *c = &bimodal[(b->pc >> 2) & BPRED_MASK];
+  bool pred = ctr_taken(*c);
+  ctr_update(c, b->taken);
+  return pred == b->taken;
+}
+
+BPredModel bpred_bimodal = {
+  .name = "bimodal", .init = bimodal_init, .predict_update = bimodal_predict_update,
+};
+
+// indexed by the pc xor the global history
+static uint8_t gshare[BPRED_ENTRIES];
+static uint32_t ghist = 0;
+
+static void gshare_init() {
+  memset(gshare, 1, sizeof(gshare));
+  ghist = 0;
+}
+
+static int gshare_predict_update(const BranchInfo *b) {
+  if (b->kind != BR_COND) return -1;
+  uint8_t *c = &gshare[((b->pc >> 2) ^ ghist) & BPRED_MASK];
+  bool pred = ctr_taken(*c);
+  ctr_update(c, b->taken);
+  ghist = ((ghist << 1) | b->taken) & BPRED_MASK;
+  return pred == b->taken;
+}
+
+BPredModel bpred_gshare = {
+  .name = "gshare", .init = gshare_init, .predict_update = gshare_predict_update,
+};
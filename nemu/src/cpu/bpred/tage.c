@@ -0,0 +1,129 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <cpu/bpred.h>
+
+/* A small TAGE: a bimodal base predictor and tagged tables indexed with
+ * geometrically longer global histories. The longest matching table
+ * provides the prediction, and a new entry is allocated in a longer table
+ * on a misprediction.
+ */
+
+#define NR_TABLE 4
+#define TABLE_BITS (CONFIG_BPRED_TABLE_BITS - 2)
+#define TABLE_MASK ((1 << TABLE_BITS) - 1)
+#define TAG_BITS 9
+#define TAG_MASK ((1 << TAG_BITS) - 1)
+#define U_RESET_PERIOD (256 * 1024)
+
+typedef struct {
+  uint16_t tag;
+  uint8_t ctr; // 3-bit, taken if >= 4
+  uint8_t u;   // 2-bit usefulness
+  bool valid;  // empty entries must not match the tag 0
+} TageEntry;
+
+static const int hist_len[NR_TABLE] = { 5, 12, 27, 60 };
+
+static uint8_t base[BPRED_ENTRIES];
+static TageEntry table[NR_TABLE][1 << TABLE_BITS];
+static uint64_t ghist = 0;
+static uint64_t nr_update = 0;
+
+static void tage_init() {
+  memset(base, 1, sizeof(base));
+  memset(table, 0, sizeof(table));
+  ghist = 0;
+  nr_update = 0;
+}
+
+// fold the latest `len` bits of history into `bits` bits
+static inline uint32_t fold(int len, int bits) {
+  uint64_t h = ghist & ((1ull << len) - 1);
+  uint32_t x = 0;
+  for (; h != 0; h >>= bits) x ^= h & ((1u << bits) - 1);
+  return x;
+}
+
+static int tage_predict_update(const BranchInfo *b) {
+  if (b->kind != BR_COND) return -1;
+
+  uint32_t pc = b->pc >> 2;
+  uint32_t idx[NR_TABLE], tag[NR_TABLE];
+  int provider = -1, alt = -1;
+  int i;
+
+  for (i = NR_TABLE - 1; i >= 0; i --) {
+    idx[i] = (pc ^ (pc >> TABLE_BITS) ^ fold(hist_len[i], TABLE_BITS)) & TABLE_MASK;
+    tag[i] = (pc ^ fold(hist_len[i], TAG_BITS) ^ (fold(hist_len[i], TAG_BITS - 1) << 1)) & TAG_MASK;
+    if (table[i][idx[i]].valid && table[i][idx[i]].tag == tag[i]) {
+      if (provider < 0) provider = i;
+      else if (alt < 0) alt = i;
+    }
+  }
+
+  uint8_t *bc = &base[pc & BPRED_MASK];
+  bool base_pred = (*bc >= 2);
+  bool alt_pred = (alt >= 0 ? table[alt][idx[alt]].ctr >= 4 : base_pred);
+  bool pred = (provider >= 0 ? table[provider][idx[provider]].ctr >= 4 : base_pred);
+
+  // train the provider
+  if (provider >= 0) {
+    TageEntry *e = &table[provider][idx[provider]];
+    if (b->taken) { if (e->ctr < 7) e->ctr ++; }
+    else if (e->ctr > 0) e->ctr --;
+    if (pred != alt_pred) {
+      if (pred == b->taken) { if (e->u < 3) e->u ++; }
+      else if (e->u > 0) e->u --;
+    }
+  } else {
+    if (b->taken) { if (*bc < 3) (*bc) ++; }
+    else if (*bc > 0) (*bc) --;
+  }
+
+  // allocate an entry in a longer table on a misprediction
+  if (pred != b->taken) {
+    bool allocated = false;
+    for (i = provider + 1; i < NR_TABLE; i ++) {
+      TageEntry *e = &table[i][idx[i]];
+      if (e->u == 0) {
+        *e = (TageEntry){ .tag = tag[i], .ctr = (b->taken ? 4 : 3), .u = 0, .valid = true };
+        allocated = true;
+        break;
+      }
+    }
+    if (!allocated) {
+      for (i = provider + 1; i < NR_TABLE; i ++) {
+        if (table[i][idx[i]].u > 0) table[i][idx[i]].u --;
+      }
+    }
+  }
+
+  // age the usefulness, so that old entries can be replaced
+  if (++ nr_update % U_RESET_PERIOD == 0) {
+    int j;
+    for (i = 0; i < NR_TABLE; i ++) {
+      for (j = 0; j <= TABLE_MASK; j ++) table[i][j].u >>= 1;
+    }
+  }
+
+  ghist = (ghist << 1) | b->taken;
+  return pred == b->taken;
+}
+
+BPredModel bpred_tage = {
+  .name = "tage", .init = tage_init, .predict_update = tage_predict_update,
+};
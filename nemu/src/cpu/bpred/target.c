@@ -0,0 +1,72 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <cpu/bpred.h>
+
+// Target predictors.
+
+#define RAS_SIZE 16
+
+// a direct-mapped branch target buffer for taken transfers except returns
+typedef struct {
+  vaddr_t pc;
+  vaddr_t target;
+  bool valid;
+} BTBEntry;
+
+static BTBEntry btb[BPRED_ENTRIES];
+
+static void btb_init() {
+  memset(btb, 0, sizeof(btb));
+}
+
+static int btb_predict_update(const BranchInfo *b) {
+  if (!b->taken || b->kind == BR_RET) return -1;
+  BTBEntry *e = &btb[(b->pc >> 2) & BPRED_MASK];
+  bool correct = e->valid && e->pc == b->pc && e->target == b->target;
+  *e = (BTBEntry){ .pc = b->pc, .target = b->target, .valid = true };
+  return correct;
+}
+
+BPredModel bpred_btb = {
+  .name = "btb", .init = btb_init, .predict_update = btb_predict_update,
+};
+
+// a circular return address stack, overwriting the oldest entry when full
+static vaddr_t ras[RAS_SIZE];
+static int ras_top = 0;
+
+static void ras_init() {
+  memset(ras, 0, sizeof(ras));
+  ras_top = 0;
+}
+
+static int ras_predict_update(const BranchInfo *b) {
+  int correct = -1;
+  if (b->kind == BR_RET) {
+    ras_top = (ras_top + RAS_SIZE - 1) % RAS_SIZE;
+    correct = (ras[ras_top] == b->target);
+  }
+  if (b->call) {
+    ras[ras_top] = b->snpc;
+    ras_top = (ras_top + 1) % RAS_SIZE;
+  }
+  return correct;
+}
+
+BPredModel bpred_ras = {
+  .name = "ras", .init = ras_init, .predict_update = ras_predict_update,
+};
@@ -16,6 +16,16 @@
 #include <cpu/cpu.h>
 #include <cpu/decode.h>
 #include <cpu/difftest.h>
+#include <cpu/simpoint.h>
+#include <cpu/inst-stat.h>
+#include <cpu/profile.h>
+#include <memory/cache.h>
+#include <cpu/bpred.h>
+#include <cpu/timing.h>
+#include <device/map.h>
+#include <cpu/watchpoint.h>
+#include <cpu/breakpoint.h>
+#include <cpu/reverse.h>
 #include <locale.h>
 
 /* The assembly code of instructions executed is only output to the screen
@@ -29,6 +39,9 @@ CPU_state cpu = {};
 uint64_t g_nr_guest_inst = 0;
 static uint64_t g_timer = 0; // unit: us
 static bool g_print_step = false;
+int g_debug_mode = DEBUG_STOP;
+static bool g_debug_stop = false; // stopped by a breakpoint or a watchpoint
+bool g_replaying = false;
 
 // To realize iringbuf
 char inst_buf[20][50];
@@ -36,24 +49,9 @@ uint32_t current_inst=0;
 
 void device_update();
 
-bool check_watchpoints();
-
-static void trace_and_difftest(Decode *_this, vaddr_t dnpc) {
-#ifdef CONFIG_ITRACE_COND
-  if (ITRACE_COND) { log_write("%s\n", _this->logbuf); }
-#endif
-  if (g_print_step) { IFDEF(CONFIG_ITRACE, puts(_this->logbuf)); }
-  IFDEF(CONFIG_DIFFTEST, difftest_step(_this->pc, dnpc));
-
-  IFDEF(CONFIG_WATCHPOINT, if (check_watchpoints()) {nemu_state.state = NEMU_STOP;})
-}
-
-static void exec_once(Decode *s, vaddr_t pc) {
-  s->pc = pc;
-  s->snpc = pc;
-  isa_exec_once(s);
-  cpu.pc = s->dnpc;
 #ifdef CONFIG_ITRACE
+// fill the log of the instruction, timed as a part of PERF_TRACE
+static void itrace_format(Decode *s) {
   char *p = s->logbuf, *q = p;
   p += snprintf(p, sizeof(s->logbuf), FMT_WORD ":", s->pc);
   int ilen = s->snpc - s->pc;
@@ -81,19 +79,60 @@ static void exec_once(Decode *s, vaddr_t pc) {
   current_inst++;
   // iringbuf
   current_inst %= 20;
+}
+#endif
+
+static void trace_and_difftest(Decode *_this, vaddr_t dnpc) {
+  IFDEF(CONFIG_ITRACE, itrace_format(_this));
+#ifdef CONFIG_ITRACE_COND
+  if (ITRACE_COND) { log_write("%s\n", _this->logbuf); }
 #endif
+  if (g_print_step) { IFDEF(CONFIG_ITRACE, puts(_this->logbuf)); }
+  IFDEF(CONFIG_DIFFTEST, PERF(PERF_DIFFTEST, difftest_step(_this->pc, dnpc)));
+
+  IFDEF(CONFIG_WATCHPOINT, if (wp_need_check() && check_watchpoints() && g_debug_mode != DEBUG_OFF) {nemu_state.state = NEMU_STOP; g_debug_stop = true;})
+}
+
+static void exec_once(Decode *s, vaddr_t pc) {
+  s->pc = pc;
+  s->snpc = pc;
+  PERF(PERF_EXEC, isa_exec_once(s));
+  cpu.pc = s->dnpc;
 }
 
 static void execute(uint64_t n) {
   Decode s;
+  // resume from the breakpoint where the execution stopped
+  IFDEF(CONFIG_BREAKPOINT, if (cpu.pc != bp_skip_pc) bp_skip_pc = -1);
   for (;n > 0; n --) {
+    IFDEF(CONFIG_BREAKPOINT, if (bp_hit(cpu.pc)) { g_debug_stop = true; break; });
     exec_once(&s, cpu.pc);
     g_nr_guest_inst ++;
-    trace_and_difftest(&s, cpu.pc);
+    IFDEF(CONFIG_SIMPOINT, simpoint_step(&s));
+    IFDEF(CONFIG_REVERSE, reverse_step_hook());
+    PERF(PERF_TRACE, trace_and_difftest(&s, cpu.pc));
     if (nemu_state.state != NEMU_RUNNING) break;
-    IFDEF(CONFIG_DEVICE, device_update());
+    IFDEF(CONFIG_DEVICE, PERF(PERF_DEVICE, device_update()));
+  }
+}
+
+#ifdef CONFIG_PROFILE
+/* Run to the sampling points of the profiler one by one, instead of
+ * checking for them after every instruction.
+ */
+static void execute_profiled(uint64_t n) {
+  g_debug_stop = false;
+  while (n > 0) {
+    if (profile_next <= g_nr_guest_inst) profile_next = g_nr_guest_inst + CONFIG_PROFILE_INTERVAL;
+    uint64_t start = g_nr_guest_inst;
+    uint64_t left = profile_next - start;
+    execute(n < left ? n : left);
+    n -= g_nr_guest_inst - start;
+    if (g_nr_guest_inst == profile_next) profile_sample(cpu.pc);
+    if (nemu_state.state != NEMU_RUNNING || g_debug_stop) break;
   }
 }
+#endif
 
 static void statistic() {
   IFNDEF(CONFIG_TARGET_AM, setlocale(LC_NUMERIC, ""));
@@ -102,6 +141,13 @@ static void statistic() {
   Log("total guest instructions = " NUMBERIC_FMT, g_nr_guest_inst);
   if (g_timer > 0) Log("simulation frequency = " NUMBERIC_FMT " inst/s", g_nr_guest_inst * 1000000 / g_timer);
   else Log("Finish running in less than 1 us and can not calculate the simulation frequency");
+  IFDEF(CONFIG_INST_STAT, inst_stat_dump());
+  IFDEF(CONFIG_PROFILE, profile_dump());
+  IFDEF(CONFIG_CACHE_SIM, cache_dump());
+  IFDEF(CONFIG_BPRED, bpred_dump());
+  IFDEF(CONFIG_TIMING, timing_dump());
+  IFDEF(CONFIG_DEVICE_STAT, device_stat_dump());
+  IFDEF(CONFIG_HOST_PERF, perf_dump());
 }
 
 void iringbuf() {
@@ -135,11 +181,13 @@ void cpu_exec(uint64_t n) {
 
   uint64_t timer_start = get_time();
 
-  execute(n);
+  PERF(PERF_RUN, MUXDEF(CONFIG_PROFILE, execute_profiled(n), execute(n)));
 
   uint64_t timer_end = get_time();
   g_timer += timer_end - timer_start;
 
+  IFDEF(CONFIG_DIFFTEST_BISECT, if (nemu_state.state == NEMU_ABORT) difftest_bisect());
+
   switch (nemu_state.state) {
     case NEMU_RUNNING: nemu_state.state = NEMU_STOP; break;
 
@@ -150,10 +198,32 @@ void cpu_exec(uint64_t n) {
             ANSI_FMT("HIT BAD TRAP", ANSI_FG_RED))),
           nemu_state.halt_pc);
       // fall through
-    case NEMU_QUIT: statistic();
+    case NEMU_QUIT:
+      IFDEF(CONFIG_SIMPOINT, simpoint_finish());
+      statistic();
   }
 }
 
+/* Re-execute `n` instructions from a restored snapshot. Unlike cpu_exec(),
+ * the timer and the final state are left to the caller. Return whether the
+ * execution is stopped by a breakpoint or a watchpoint. The instructions are
+ * already counted by the statistics, and the profiler does not sample them.
+ */
+bool cpu_replay(uint64_t n) {
+  g_debug_stop = false;
+  nemu_state.state = NEMU_RUNNING;
+  g_replaying = true;
+  execute(n);
+  g_replaying = false;
+  if (nemu_state.state == NEMU_RUNNING) nemu_state.state = NEMU_STOP;
+  return g_debug_stop;
+}
+
+// host time spent on the execution of the guest, in us
+uint64_t cpu_host_time() {
+  return g_timer;
+}
+
 void cpu_quit() {
   nemu_state.state = NEMU_QUIT;
 }
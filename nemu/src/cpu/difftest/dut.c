@@ -17,7 +17,9 @@
 
 #include <isa.h>
 #include <cpu/cpu.h>
+#include <memory/host.h>
 #include <memory/paddr.h>
+#include <memory/snapshot.h>
 #include <utils.h>
 #include <difftest-def.h>
 
@@ -59,6 +61,187 @@ void difftest_skip_dut(int nr_ref, int nr_dut) {
   }
 }
 
+#ifdef CONFIG_DIFFTEST_BATCH
+static int (*ref_difftest_exec_until)(vaddr_t pc, uint64_t nr_hit) = NULL;
+static int (*ref_difftest_need_step)(vaddr_t pc) = NULL;
+static void (*ref_difftest_raise_intr_step)(uint64_t NO) = NULL;
+
+static bool batch_enable = false;
+static bool batch_resume = false; // back to batch mode after the next step
+static vaddr_t batch_pc[CONFIG_DIFFTEST_BATCH_SIZE] = {};
+static int batch_len = 0;
+static vaddr_t batch_npc = 0;
+static CPU_state batch_last = {}; // DUT state before the latest instruction
+static CPU_state batch_start = {}; // DUT state before the first instruction
+
+// the stores of DUT to pmem in the current batch, with the overwritten data
+typedef struct {
+  paddr_t addr;
+  int len;
+  word_t data;
+} BatchStore;
+static BatchStore *batch_store = NULL;
+static size_t nr_batch_store = 0, max_batch_store = 0;
+
+static void batch_begin() {
+  batch_len = 0;
+  nr_batch_store = 0;
+  batch_start = cpu;
+}
+
+void difftest_track_write(paddr_t addr, int len) {
+  if (!batch_enable) return;
+  if (nr_batch_store == max_batch_store) {
+    max_batch_store = (max_batch_store == 0 ? 1024 : max_batch_store * 2);
+    batch_store = realloc(batch_store, sizeof(batch_store[0]) * max_batch_store);
+    assert(batch_store);
+  }
+  batch_store[nr_batch_store ++] = (BatchStore){ .addr = addr, .len = len,
+    .data = host_read(guest_to_host(addr), len) };
+}
+
+// Swap the data of the stores with the memory. Going from the latest store
+// brings the memory back to the start of the batch, and going from the
+// first one again brings it forward to now.
+static void batch_swap_stores(bool backward) {
+  size_t k;
+  for (k = 0; k < nr_batch_store; k ++) {
+    BatchStore *st = &batch_store[backward ? nr_batch_store - 1 - k : k];
+    uint8_t *p = guest_to_host(st->addr);
+    word_t data = host_read(p, st->len);
+    host_write(p, st->len, st->data);
+    st->data = data;
+  }
+}
+
+// Make REF identical to DUT again and check every instruction from now on.
+static void batch_fallback(const char *reason) {
+  Log("Differential testing: %s, fall back to single-step mode", reason);
+  batch_enable = false;
+  batch_len = 0;
+  ref_difftest_memcpy(PMEM_LEFT, guest_to_host(PMEM_LEFT), CONFIG_MSIZE, DIFFTEST_TO_REF);
+  ref_difftest_regcpy(&cpu, DIFFTEST_TO_REF);
+}
+
+static bool batch_check(vaddr_t target, CPU_state *dut) {
+  CPU_state ref_r;
+  ref_difftest_regcpy(&ref_r, DIFFTEST_TO_DUT);
+
+  // isa_difftest_checkregs() always checks against `cpu`
+  CPU_state now = cpu;
+  cpu = *dut;
+  bool ok = isa_difftest_checkregs(&ref_r, target);
+  cpu = now;
+  return ok;
+}
+
+// REF runs the batch freely, so it may go wrong on the instructions which
+// it only handles in single-step mode. Run the first `len` instructions of
+// the batch again from its start in single-step mode, before reporting an
+// error.
+static bool batch_retry(int len, vaddr_t target, CPU_state *dut) {
+  batch_swap_stores(true);
+  ref_difftest_memcpy(PMEM_LEFT, guest_to_host(PMEM_LEFT), CONFIG_MSIZE, DIFFTEST_TO_REF);
+  batch_swap_stores(false);
+  ref_difftest_regcpy(&batch_start, DIFFTEST_TO_REF);
+  ref_difftest_exec(len);
+  return batch_check(target, dut);
+}
+
+// Let REF run the first `len` instructions recorded in `batch_pc[]`, which
+// stops right before `target`, and compare its registers with `dut`.
+static bool batch_sync(int len, vaddr_t target, CPU_state *dut) {
+  if (len == 0) return true;
+
+  // REF starts at `batch_pc[0]` with its breakpoint suppressed, so we
+  // count the later arrivals at `target` plus the final one
+  uint64_t nr_hit = 1;
+  int i;
+  for (i = 1; i < len; i ++) {
+    if (batch_pc[i] == target) nr_hit ++;
+  }
+
+  if (!ref_difftest_exec_until(target, nr_hit)) {
+    batch_fallback("reference can not reach the sync point");
+    return false;
+  }
+
+  bool ok = batch_check(target, dut) || batch_retry(len, target, dut);
+  if (!ok) {
+    Log("The error is within the last %d instructions starting from pc = " FMT_WORD
+        ", disable CONFIG_DIFFTEST_BATCH to locate it", len, batch_pc[0]);
+    nemu_state.state = NEMU_ABORT;
+    nemu_state.halt_pc = target;
+    isa_reg_display();
+  }
+  return ok;
+}
+
+static void batch_step(vaddr_t pc, vaddr_t npc) {
+  batch_pc[batch_len ++] = pc;
+
+  if (is_skip_ref) {
+    // the current instruction can not be run by REF, sync right before it
+    is_skip_ref = false;
+    if (batch_sync(batch_len - 1, pc, &batch_last) && batch_enable) {
+      ref_difftest_regcpy(&cpu, DIFFTEST_TO_REF);
+    }
+    batch_begin();
+  } else if (ref_difftest_need_step(pc)) {
+    // REF patches the current instruction in single-step mode, sync right
+    // before it and let REF step over it
+    if (batch_sync(batch_len - 1, pc, &batch_last) && batch_enable) {
+      ref_difftest_exec(1);
+      if (!batch_check(npc, &cpu)) {
+        nemu_state.state = NEMU_ABORT;
+        nemu_state.halt_pc = pc;
+        isa_reg_display();
+      }
+    }
+    batch_begin();
+  } else if (batch_len == CONFIG_DIFFTEST_BATCH_SIZE) {
+    batch_sync(batch_len, npc, &cpu);
+    batch_begin();
+  }
+
+  batch_npc = npc;
+  batch_last = cpu;
+}
+
+static void batch_raise_intr(uint64_t NO) {
+  // REF is lagging behind, let it catch up and then take the interrupt
+  // in single-step mode
+  if (batch_enable && batch_sync(batch_len, batch_npc, &batch_last)) {
+    batch_enable = false;
+    batch_resume = true;
+  }
+  batch_len = 0;
+  ref_difftest_raise_intr_step(NO);
+}
+
+// Called after an instruction is checked in single-step mode.
+static void batch_try_resume() {
+  if (!batch_resume || nemu_state.state == NEMU_ABORT) return;
+  batch_resume = false;
+  batch_enable = true;
+  batch_last = cpu;
+  batch_begin();
+}
+#endif
+
+// Make REF identical to DUT, e.g. after DUT is restored to a snapshot.
+void difftest_sync() {
+  if (ref_difftest_memcpy == NULL) return;
+  is_skip_ref = false;
+  skip_dut_nr_inst = 0;
+#ifdef CONFIG_DIFFTEST_BATCH
+  batch_begin();
+  batch_last = cpu;
+#endif
+  ref_difftest_memcpy(PMEM_LEFT, guest_to_host(PMEM_LEFT), CONFIG_MSIZE, DIFFTEST_TO_REF);
+  ref_difftest_regcpy(&cpu, DIFFTEST_TO_REF);
+}
+
 void init_difftest(char *ref_so_file, long img_size, int port) {
   assert(ref_so_file != NULL);
 
@@ -89,12 +272,42 @@ void init_difftest(char *ref_so_file, long img_size, int port) {
   ref_difftest_init(port);
   ref_difftest_memcpy(RESET_VECTOR, guest_to_host(RESET_VECTOR), img_size, DIFFTEST_TO_REF);
   ref_difftest_regcpy(&cpu, DIFFTEST_TO_REF);
+
+  IFDEF(CONFIG_DIFFTEST_BISECT, snapshot_take(false));
+
+#ifdef CONFIG_DIFFTEST_BATCH
+  ref_difftest_exec_until = dlsym(handle, "difftest_exec_until");
+  ref_difftest_need_step = dlsym(handle, "difftest_need_step");
+  if (ref_difftest_exec_until != NULL && ref_difftest_need_step != NULL) {
+    ref_difftest_raise_intr_step = ref_difftest_raise_intr;
+    ref_difftest_raise_intr = batch_raise_intr;
+    batch_last = cpu;
+    batch_begin();
+    batch_enable = true;
+    Log("Differential testing: batch mode with at most %d instructions per batch",
+        CONFIG_DIFFTEST_BATCH_SIZE);
+  }
+#endif
+}
+
+#ifdef CONFIG_DIFFTEST_BISECT
+static bool is_bisecting = false;
+static bool is_mismatch = false;
+static vaddr_t bisect_last_pc = 0;
+
+static void bisect_step(vaddr_t pc) {
+  bisect_last_pc = pc;
+  if (is_bisecting || nemu_state.state == NEMU_ABORT) return;
+  extern uint64_t g_nr_guest_inst;
+  if (g_nr_guest_inst % CONFIG_DIFFTEST_BISECT_INTERVAL == 0) snapshot_take(false);
 }
+#endif
 
 static void checkregs(CPU_state *ref, vaddr_t pc) {
   if (!isa_difftest_checkregs(ref, pc)) {
     nemu_state.state = NEMU_ABORT;
     nemu_state.halt_pc = pc;
+    IFDEF(CONFIG_DIFFTEST_BISECT, is_mismatch = true; if (is_bisecting) return);
     isa_reg_display();
   }
 }
@@ -102,6 +315,13 @@ static void checkregs(CPU_state *ref, vaddr_t pc) {
 void difftest_step(vaddr_t pc, vaddr_t npc) {
   CPU_state ref_r;
 
+#ifdef CONFIG_DIFFTEST_BATCH
+  if (batch_enable) {
+    batch_step(pc, npc);
+    return;
+  }
+#endif
+
   if (skip_dut_nr_inst > 0) {
     ref_difftest_regcpy(&ref_r, DIFFTEST_TO_DUT);
     if (ref_r.pc == npc) {
@@ -119,6 +339,7 @@ void difftest_step(vaddr_t pc, vaddr_t npc) {
     // to skip the checking of an instruction, just copy the reg state to reference design
     ref_difftest_regcpy(&cpu, DIFFTEST_TO_REF);
     is_skip_ref = false;
+    IFDEF(CONFIG_DIFFTEST_BISECT, bisect_step(pc));
     return;
   }
 
@@ -126,7 +347,88 @@ void difftest_step(vaddr_t pc, vaddr_t npc) {
   ref_difftest_regcpy(&ref_r, DIFFTEST_TO_DUT);
 
   checkregs(&ref_r, pc);
+  IFDEF(CONFIG_DIFFTEST_BISECT, bisect_step(pc));
+  IFDEF(CONFIG_DIFFTEST_BATCH, batch_try_resume());
+}
+
+#ifdef CONFIG_DIFFTEST_BISECT
+static uint64_t hash_mem(const uint8_t *p) {
+  // FNV-1a on 64-bit words
+  const uint64_t *w = (const uint64_t *)p;
+  uint64_t h = 0xcbf29ce484222325ull;
+  size_t i;
+  for (i = 0; i < CONFIG_MSIZE / sizeof(w[0]); i ++) {
+    h = (h ^ w[i]) * 0x100000001b3ull;
+  }
+  return h;
+}
+
+// Restore both DUT and REF to snapshot `idx`, then let them run `n`
+// instructions. Return whether any architectural state diverges.
+static bool bisect_probe(int idx, uint64_t n, uint8_t *ref_mem) {
+  // REF is synchronized as well
+  snapshot_restore(idx);
+  is_mismatch = false;
+
+  if (n > 0) cpu_replay(n);
+  if (is_mismatch) return true;
+
+  ref_difftest_memcpy(PMEM_LEFT, ref_mem, CONFIG_MSIZE, DIFFTEST_TO_DUT);
+  return hash_mem(ref_mem) != hash_mem(guest_to_host(PMEM_LEFT));
+}
+
+// Called when the execution is aborted. If it is caused by a mismatch of
+// registers, find the earliest instruction after which the registers or
+// the memory of DUT and REF diverge.
+void difftest_bisect() {
+  if (!is_mismatch || is_bisecting) return;
+
+  extern uint64_t g_nr_guest_inst;
+  uint64_t end = g_nr_guest_inst;
+  vaddr_t halt_pc = nemu_state.halt_pc;
+  uint8_t *ref_mem = malloc(CONFIG_MSIZE);
+  assert(ref_mem);
+  is_bisecting = true;
+  // the replays must run exactly the given number of instructions
+  int debug_mode = g_debug_mode;
+  g_debug_mode = DEBUG_OFF;
+
+  // The root cause may be earlier than the latest snapshot if the memory
+  // has already diverged when the snapshot is taken. In this case, the
+  // mismatch can not be reproduced, so try an older snapshot.
+  int idx;
+  for (idx = snapshot_count() - 1; idx >= 0; idx --) {
+    Log("Differential testing: re-run from the snapshot at instruction %" PRIu64,
+        snapshot_nr_inst(idx));
+    if (bisect_probe(idx, end - snapshot_nr_inst(idx), ref_mem)) break;
+  }
+
+  if (idx < 0) {
+    Log("Differential testing: can not reproduce the mismatch from any snapshot");
+  } else {
+    // invariant: the state is the same after `lo` instructions,
+    // but diverges after `hi` instructions
+    uint64_t lo = 0, hi = end - snapshot_nr_inst(idx);
+    while (hi - lo > 1) {
+      uint64_t mid = lo + (hi - lo) / 2;
+      if (bisect_probe(idx, mid, ref_mem)) hi = mid;
+      else lo = mid;
+    }
+
+    // leave DUT at the first divergence for further inspection
+    bisect_probe(idx, hi, ref_mem);
+    Log("Differential testing: the first divergence is caused by instruction %" PRIu64
+        " at pc = " FMT_WORD, g_nr_guest_inst, bisect_last_pc);
+    isa_reg_display();
+  }
+
+  free(ref_mem);
+  is_bisecting = false;
+  g_debug_mode = debug_mode;
+  nemu_state.state = NEMU_ABORT;
+  nemu_state.halt_pc = (idx < 0 ? halt_pc : bisect_last_pc);
 }
+#endif
 #else
 void init_difftest(char *ref_so_file, long img_size, int port) { }
 #endif
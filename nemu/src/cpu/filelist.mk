@@ -0,0 +1,38 @@
+#***************************************************************************************
+# Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+#
+# NEMU is licensed under Mulan PSL v2.
+# You can use this software according to the terms and conditions of the Mulan PSL v2.
+# You may obtain a copy of Mulan PSL v2 at:
+#          http://license.coscl.org.cn/MulanPSL2
+#
+# THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+# EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+# MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+#
+# See the Mulan PSL v2 for more details.
+#**************************************************************************************/
+
+ifndef CONFIG_SIMPOINT
+SRCS-BLACKLIST-y += src/cpu/simpoint.c
+endif
+
+ifndef CONFIG_INST_STAT
+SRCS-BLACKLIST-y += src/cpu/inst-stat.c
+endif
+
+ifndef CONFIG_BPRED
+DIRS-BLACKLIST-y += src/cpu/bpred
+endif
+
+ifndef CONFIG_TIMING
+SRCS-BLACKLIST-y += src/cpu/timing.c
+endif
+
+ifndef CONFIG_PROFILE
+SRCS-BLACKLIST-y += src/cpu/profile.c
+endif
+
+ifndef CONFIG_REVERSE
+SRCS-BLACKLIST-y += src/cpu/reverse.c
+endif
@@ -0,0 +1,110 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <cpu/cpu.h>
+#include <cpu/inst-stat.h>
+
+static InstStat *head = NULL;
+static int nr_stat = 0;
+static const char *csv_file = NULL;
+
+static const char *class_name[NR_INST_CLASS] = {
+  [INST_ALU] = "alu", [INST_LOAD] = "load", [INST_STORE] = "store",
+  [INST_BRANCH] = "branch", [INST_JUMP] = "jump", [INST_MUL] = "mul",
+  [INST_DIV] = "div", [INST_SYSTEM] = "system",
+};
+
+void inst_stat_register(InstStat *st, int cls) {
+  st->cls = cls;
+  st->next = head;
+  head = st;
+  nr_stat ++;
+}
+
+void init_inst_stat(const char *file) {
+  csv_file = file;
+}
+
+static int cmp_count(const void *a, const void *b) {
+  uint64_t x = (*(InstStat **)a)->count, y = (*(InstStat **)b)->count;
+  return (x < y) - (x > y);
+}
+
+static inline double percent(uint64_t x, uint64_t total) {
+  return (total == 0 ? 0 : 100.0 * x / total);
+}
+
+static void dump_csv(InstStat **list) {
+  FILE *fp = fopen(csv_file, "w");
+  if (fp == NULL) {
+    Log("Can not open '%s' to write the instruction statistics", csv_file);
+    return;
+  }
+  fprintf(fp, "name,class,count,taken\n");
+  int i;
+  for (i = 0; i < nr_stat; i ++) {
+    fprintf(fp, "%s,%s,%" PRIu64 ",%" PRIu64 "\n", list[i]->name,
+        class_name[list[i]->cls], list[i]->count, list[i]->taken);
+  }
+  fclose(fp);
+  Log("Instruction statistics are written to %s", csv_file);
+}
+
+void inst_stat_dump() {
+  uint64_t count[NR_INST_CLASS] = {}, taken[NR_INST_CLASS] = {};
+  uint64_t total = 0;
+  InstStat **list = malloc(sizeof(list[0]) * (nr_stat + 1));
+  InstStat *st;
+  int i;
+
+  assert(list);
+  for (st = head, i = 0; st != NULL; st = st->next, i ++) {
+    list[i] = st;
+    count[st->cls] += st->count;
+    taken[st->cls] += st->taken;
+    total += st->count;
+  }
+  qsort(list, nr_stat, sizeof(list[0]), cmp_count);
+
+  char taken_str[16];
+
+  Log("executed instructions by class:");
+  _Log("  %-8s %16s %7s %8s\n", "class", "count", "%", "taken%");
+  for (i = 0; i < NR_INST_CLASS; i ++) {
+    if (count[i] == 0) continue;
+    taken_str[0] = '\0';
+    if (i == INST_BRANCH || i == INST_JUMP) {
+      snprintf(taken_str, sizeof(taken_str), "%8.2f", percent(taken[i], count[i]));
+    }
+    _Log("  %-8s %16" PRIu64 " %7.2f %s\n", class_name[i], count[i],
+        percent(count[i], total), taken_str);
+  }
+
+  Log("executed instructions by opcode:");
+  _Log("  %-8s %-8s %16s %7s %8s\n", "name", "class", "count", "%", "taken%");
+  for (i = 0; i < nr_stat; i ++) {
+    st = list[i];
+    taken_str[0] = '\0';
+    if (st->cls == INST_BRANCH) {
+      snprintf(taken_str, sizeof(taken_str), "%8.2f", percent(st->taken, st->count));
+    }
+    _Log("  %-8s %-8s %16" PRIu64 " %7.2f %s\n", st->name, class_name[st->cls],
+        st->count, percent(st->count, total), taken_str);
+  }
+
+  if (csv_file != NULL) dump_csv(list);
+  free(list);
+}
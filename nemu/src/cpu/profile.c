@@ -0,0 +1,231 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <isa.h>
+#include <cpu/profile.h>
+#include <memory/snapshot.h>
+#include <ftrace.h>
+
+/* Sample the pc and the shadow call stack every CONFIG_PROFILE_INTERVAL
+ * instructions. The hot functions and pcs are reported at exit, and the
+ * call stacks can be written in the folded format of FlameGraph:
+ *   main;foo;bar count
+ */
+
+#define TOP_N 20
+
+uint64_t profile_next = CONFIG_PROFILE_INTERVAL;
+vaddr_t profile_stack[PROFILE_MAX_DEPTH] = {};
+int profile_depth = 0;
+
+static uint64_t nr_sample = 0;
+static const char *folded_file = NULL;
+
+typedef struct {
+  vaddr_t pc;
+  uint64_t count; // count == 0 means empty
+} PCEntry;
+
+typedef struct {
+  uint32_t hash;
+  int depth;
+  vaddr_t *frames;
+  uint64_t count;
+} StackEntry;
+
+// both are open addressing tables, kept at most half full
+static PCEntry *pc_table = NULL;
+static uint32_t pc_mask = 0, nr_pc = 0;
+static StackEntry *stack_table = NULL;
+static uint32_t stack_mask = 0, nr_stack = 0;
+
+static inline uint32_t hash_pc(vaddr_t pc) {
+  return (uint32_t)((pc >> 1) * 0x9e3779b1u);
+}
+
+static PCEntry *pc_lookup(PCEntry *table, uint32_t mask, vaddr_t pc) {
+  uint32_t i;
+  for (i = hash_pc(pc) & mask; table[i].count != 0 && table[i].pc != pc; i = (i + 1) & mask);
+  return &table[i];
+}
+
+static void pc_grow() {
+  PCEntry *old = pc_table;
+  uint32_t old_size = (old == NULL ? 0 : pc_mask + 1);
+  uint32_t size = (old == NULL ? 1024 : old_size * 2), i;
+
+  pc_table = calloc(size, sizeof(pc_table[0]));
+  assert(pc_table);
+  pc_mask = size - 1;
+  for (i = 0; i < old_size; i ++) {
+    if (old[i].count != 0) *pc_lookup(pc_table, pc_mask, old[i].pc) = old[i];
+  }
+  free(old);
+}
+
+static StackEntry *stack_lookup(StackEntry *table, uint32_t mask,
+    uint32_t hash, const vaddr_t *frames, int depth) {
+  uint32_t i;
+  for (i = hash & mask; table[i].count != 0; i = (i + 1) & mask) {
+    if (table[i].hash == hash && table[i].depth == depth &&
+        memcmp(table[i].frames, frames, sizeof(frames[0]) * depth) == 0) break;
+  }
+  return &table[i];
+}
+
+static void stack_grow() {
+  StackEntry *old = stack_table;
+  uint32_t old_size = (old == NULL ? 0 : stack_mask + 1);
+  uint32_t size = (old == NULL ? 256 : old_size * 2), i;
+
+  stack_table = calloc(size, sizeof(stack_table[0]));
+  assert(stack_table);
+  stack_mask = size - 1;
+  for (i = 0; i < old_size; i ++) {
+    if (old[i].count != 0) {
+      *stack_lookup(stack_table, stack_mask, old[i].hash, old[i].frames, old[i].depth) = old[i];
+    }
+  }
+  free(old);
+}
+
+static void sample_stack(vaddr_t pc) {
+  vaddr_t frames[PROFILE_MAX_DEPTH + 1];
+  int depth = (profile_depth < PROFILE_MAX_DEPTH ? profile_depth : PROFILE_MAX_DEPTH);
+  uint32_t hash = 2166136261u;
+  int i;
+
+  memcpy(frames, profile_stack, sizeof(frames[0]) * depth);
+  // the leaf is the entry of the function containing `pc', if known
+  i = find_function(pc);
+  vaddr_t leaf = (i >= 0 ? functions[i].start_addr : pc);
+  if (frames[depth - 1] != leaf) frames[depth ++] = leaf;
+
+  for (i = 0; i < depth; i ++) hash = (hash ^ frames[i]) * 16777619u;
+
+  if ((nr_stack + 1) * 2 > stack_mask + 1) stack_grow();
+  StackEntry *e = stack_lookup(stack_table, stack_mask, hash, frames, depth);
+  if (e->count == 0) {
+    e->hash = hash;
+    e->depth = depth;
+    e->frames = malloc(sizeof(frames[0]) * depth);
+    assert(e->frames);
+    memcpy(e->frames, frames, sizeof(frames[0]) * depth);
+    nr_stack ++;
+  }
+  e->count ++;
+}
+
+// Called with the pc of the next instruction when profile_next is reached.
+void profile_sample(vaddr_t pc) {
+  profile_next += CONFIG_PROFILE_INTERVAL;
+  nr_sample ++;
+
+  if ((nr_pc + 1) * 2 > pc_mask + 1) pc_grow();
+  PCEntry *e = pc_lookup(pc_table, pc_mask, pc);
+  if (e->count == 0) {
+    e->pc = pc;
+    nr_pc ++;
+  }
+  e->count ++;
+
+  if (folded_file != NULL) sample_stack(pc);
+}
+
+void init_profile(const char *file) {
+  folded_file = file;
+  profile_stack[0] = cpu.pc;
+  profile_depth = 1;
+  // `profile_next` is not restored, so replayed instructions are not sampled again
+  IFDEF(CONFIG_SNAPSHOT, snapshot_add_tool_state("profile.stack", profile_stack, sizeof(profile_stack)));
+  IFDEF(CONFIG_SNAPSHOT, snapshot_add_tool_state("profile.depth", &profile_depth, sizeof(profile_depth)));
+}
+
+static void frame_name(char *buf, int size, vaddr_t pc) {
+  int i = find_function(pc);
+  if (i >= 0 && pc == functions[i].start_addr) snprintf(buf, size, "%s", functions[i].name);
+  else if (i >= 0) snprintf(buf, size, "%s+0x%x", functions[i].name, (uint32_t)(pc - functions[i].start_addr));
+  else snprintf(buf, size, FMT_WORD, pc);
+}
+
+static void dump_folded() {
+  FILE *fp = fopen(folded_file, "w");
+  char name[300];
+  uint32_t i;
+  int j;
+
+  if (fp == NULL) {
+    Log("Can not open '%s' to write the profile", folded_file);
+    return;
+  }
+  for (i = 0; i <= stack_mask && stack_table != NULL; i ++) {
+    StackEntry *e = &stack_table[i];
+    if (e->count == 0) continue;
+    for (j = 0; j < e->depth; j ++) {
+      frame_name(name, sizeof(name), e->frames[j]);
+      fprintf(fp, "%s%s", (j == 0 ? "" : ";"), name);
+    }
+    fprintf(fp, " %" PRIu64 "\n", e->count);
+  }
+  fclose(fp);
+  Log("The sampled call stacks are written to %s", folded_file);
+}
+
+static int cmp_count(const void *a, const void *b) {
+  uint64_t x = ((PCEntry *)a)->count, y = ((PCEntry *)b)->count;
+  return (x < y) - (x > y);
+}
+
+void profile_dump() {
+  // per function, reusing PCEntry with the index of the function as `pc'
+  PCEntry *funcs = calloc(num_functions + 1, sizeof(funcs[0]));
+  PCEntry *pcs = malloc(sizeof(pcs[0]) * (nr_pc + 1));
+  char name[300];
+  uint32_t i, n = 0;
+
+  assert(funcs && pcs);
+  for (i = 0; i <= num_functions; i ++) funcs[i].pc = i;
+  for (i = 0; i <= pc_mask && pc_table != NULL; i ++) {
+    if (pc_table[i].count == 0) continue;
+    pcs[n ++] = pc_table[i];
+    int f = find_function(pc_table[i].pc);
+    funcs[f < 0 ? num_functions : f].count += pc_table[i].count;
+  }
+  qsort(funcs, num_functions + 1, sizeof(funcs[0]), cmp_count);
+  qsort(pcs, n, sizeof(pcs[0]), cmp_count);
+
+  Log("profile: %" PRIu64 " samples, one every %d instructions", nr_sample, CONFIG_PROFILE_INTERVAL);
+  if (nr_sample == 0) goto done;
+
+  Log("hot functions:");
+  for (i = 0; i < TOP_N && i <= num_functions && funcs[i].count != 0; i ++) {
+    _Log("  %6.2f%% %12" PRIu64 "  %s\n", 100.0 * funcs[i].count / nr_sample, funcs[i].count,
+        (funcs[i].pc == num_functions ? "???" : functions[funcs[i].pc].name));
+  }
+
+  Log("hot pcs:");
+  for (i = 0; i < TOP_N && i < n; i ++) {
+    frame_name(name, sizeof(name), pcs[i].pc);
+    _Log("  %6.2f%% %12" PRIu64 "  " FMT_WORD "  %s\n", 100.0 * pcs[i].count / nr_sample,
+        pcs[i].count, pcs[i].pc, name);
+  }
+
+  if (folded_file != NULL) dump_folded();
+
+done:
+  free(funcs);
+  free(pcs);
+}
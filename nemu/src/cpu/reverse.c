@@ -0,0 +1,164 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <isa.h>
+#include <cpu/cpu.h>
+#include <cpu/reverse.h>
+#include <cpu/breakpoint.h>
+#include <memory/snapshot.h>
+
+/* Reverse execution. A snapshot is taken every REVERSE_INTERVAL instructions.
+ * Going back to instruction N restores the latest snapshot before N and runs
+ * forward to N again. The instruction counts of the snapshots are multiples
+ * of the interval, so the snapshots dropped by a restore are taken again
+ * when running forward.
+ */
+
+void wp_sync();
+
+uint64_t reverse_next_snapshot = -1;
+
+typedef struct {
+  uint64_t nr_inst;
+  uint64_t val;
+} Input;
+
+static Input *input = NULL;
+static size_t nr_input = 0, max_input = 0;
+static size_t input_pos = 0; // the next input to replay
+
+bool reverse_replay_input(uint64_t *val) {
+  if (input_pos < nr_input) {
+    if (input[input_pos].nr_inst == g_nr_guest_inst) {
+      *val = input[input_pos ++].val;
+      return true;
+    }
+    // the execution diverges from the history, forget the rest of it
+    nr_input = input_pos;
+  }
+  return false;
+}
+
+void reverse_log_input(uint64_t val) {
+  if (nr_input == max_input) {
+    max_input = (max_input == 0 ? 1024 : max_input * 2);
+    input = realloc(input, sizeof(input[0]) * max_input);
+    assert(input);
+  }
+  input[nr_input ++] = (Input){ .nr_inst = g_nr_guest_inst, .val = val };
+  input_pos = nr_input;
+}
+
+// the first input at or after instruction `nr_inst`
+static size_t input_lower_bound(uint64_t nr_inst) {
+  size_t lo = 0, hi = nr_input;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (input[mid].nr_inst < nr_inst) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+static void update_next_snapshot() {
+  reverse_next_snapshot = (g_nr_guest_inst / CONFIG_REVERSE_INTERVAL + 1) * CONFIG_REVERSE_INTERVAL;
+}
+
+void reverse_take_snapshot() {
+  snapshot_take(false);
+  update_next_snapshot();
+
+  // the inputs before the oldest snapshot will never be replayed
+  size_t n = input_lower_bound(snapshot_nr_inst(0));
+  if (n > 0) {
+    memmove(input, input + n, sizeof(input[0]) * (nr_input - n));
+    nr_input -= n;
+    input_pos -= n;
+  }
+}
+
+// restore the latest snapshot no later than `nr_inst`, or the oldest one
+static void restore_before(uint64_t nr_inst) {
+  int idx;
+  for (idx = snapshot_count() - 1; idx > 0 && snapshot_nr_inst(idx) > nr_inst; idx --);
+  snapshot_restore(idx);
+  input_pos = input_lower_bound(g_nr_guest_inst);
+  update_next_snapshot();
+  nemu_state.state = NEMU_STOP;
+  IFDEF(CONFIG_WATCHPOINT, wp_sync());
+}
+
+// run forward to instruction `nr_inst` without stopping
+static void run_to(uint64_t nr_inst) {
+  int debug_mode = g_debug_mode;
+  g_debug_mode = DEBUG_OFF;
+  if (g_nr_guest_inst < nr_inst) cpu_replay(nr_inst - g_nr_guest_inst);
+  g_debug_mode = debug_mode;
+}
+
+void reverse_step(uint64_t n) {
+  uint64_t target = (n > g_nr_guest_inst ? 0 : g_nr_guest_inst - n);
+  restore_before(target);
+  if (g_nr_guest_inst > target) {
+    printf("Reached the beginning of the history.\n");
+  }
+  run_to(target);
+}
+
+/* Go back to the latest point before now where a breakpoint or a watchpoint
+ * stops the execution. Search the intervals between snapshots from the
+ * latest one. Return false if there is no such point in the history.
+ */
+bool reverse_continue() {
+  uint64_t now = g_nr_guest_inst;
+  uint64_t end = now;
+  int debug_mode = g_debug_mode;
+
+  while (end > 0) {
+    restore_before(end - 1);
+    uint64_t start = g_nr_guest_inst;
+    bool is_oldest = (snapshot_count() == 1);
+    if (start >= end) break;
+
+    // find the last stop in [start, end], except the current one
+    uint64_t last = -1;
+    g_debug_mode = DEBUG_QUIET;
+    while (g_nr_guest_inst < end) {
+      bool stop = cpu_replay(end - g_nr_guest_inst);
+      if (!stop || nemu_state.state != NEMU_STOP) break;
+      if (g_nr_guest_inst < now) last = g_nr_guest_inst;
+    }
+    g_debug_mode = debug_mode;
+
+    if (last != -1) {
+      restore_before(last);
+      run_to(last);
+      IFDEF(CONFIG_BREAKPOINT, bp_skip_pc = cpu.pc);
+      return true;
+    }
+    if (is_oldest) break;
+    end = start;
+  }
+
+  restore_before(0);
+  printf("Reached the beginning of the history.\n");
+  return false;
+}
+
+void init_reverse() {
+  reverse_take_snapshot();
+  Log("Reverse execution: a snapshot is taken every %d instructions", CONFIG_REVERSE_INTERVAL);
+}
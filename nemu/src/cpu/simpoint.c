@@ -0,0 +1,201 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <isa.h>
+#include <cpu/cpu.h>
+#include <cpu/simpoint.h>
+#include <memory/checkpoint.h>
+
+/* Basic block vectors in the format of SimPoint. Each line is an interval:
+ *   T:id:count :id:count ...
+ * where `id` (starting from 1) identifies a block by its start pc, and
+ * `count` is the number of instructions executed in that block.
+ */
+
+typedef struct {
+  vaddr_t pc;
+  uint32_t id;
+} BlockEntry;
+
+static BlockEntry *table = NULL;  // open addressing, id == 0 means empty
+static uint32_t table_mask = 0;
+static uint32_t nr_block = 0;
+
+static uint64_t *bb_count = NULL; // indexed by id
+static uint32_t *touched = NULL;  // ids with non-zero count in this interval
+static uint32_t nr_touched = 0;
+static uint32_t max_block = 0;
+
+static FILE *bbv_fp = NULL;
+static vaddr_t bb_pc = 0;
+static uint64_t bb_start = 0;     // g_nr_guest_inst when the block starts
+static uint64_t next_interval = -1;
+
+static uint64_t *ckpt_inst = NULL;
+static int nr_ckpt = 0, ckpt_idx = 0;
+#ifdef CONFIG_CHECKPOINT
+static const char *ckpt_prefix = NULL;
+#endif
+
+bool simpoint_bbv_enable = false;
+uint64_t simpoint_next_event = -1;
+
+static inline uint32_t hash_pc(vaddr_t pc) {
+  return (uint32_t)((pc >> 1) * 0x9e3779b1u);
+}
+
+static void table_insert(vaddr_t pc, uint32_t id) {
+  uint32_t i;
+  for (i = hash_pc(pc) & table_mask; table[i].id != 0; i = (i + 1) & table_mask);
+  table[i] = (BlockEntry){ .pc = pc, .id = id };
+}
+
+static void table_grow() {
+  BlockEntry *old = table;
+  uint32_t old_size = table_mask + 1;
+  table_mask = (table == NULL ? 4096 : old_size * 2) - 1;
+  table = calloc(table_mask + 1, sizeof(table[0]));
+  assert(table);
+  uint32_t i;
+  for (i = 0; old != NULL && i < old_size; i ++) {
+    if (old[i].id != 0) table_insert(old[i].pc, old[i].id);
+  }
+  free(old);
+}
+
+static uint32_t block_id(vaddr_t pc) {
+  uint32_t i;
+  for (i = hash_pc(pc) & table_mask; table[i].id != 0; i = (i + 1) & table_mask) {
+    if (table[i].pc == pc) return table[i].id;
+  }
+
+  // a new block, keep the load factor below 1/2
+  if ((nr_block + 1) * 2 > table_mask + 1) table_grow();
+  uint32_t id = ++ nr_block;
+  table_insert(pc, id);
+  if (id >= max_block) {
+    max_block = (max_block == 0 ? 4096 : max_block * 2);
+    bb_count = realloc(bb_count, sizeof(bb_count[0]) * max_block);
+    touched = realloc(touched, sizeof(touched[0]) * max_block);
+    assert(bb_count && touched);
+  }
+  bb_count[id] = 0;
+  return id;
+}
+
+static void account_block() {
+  uint64_t n = g_nr_guest_inst - bb_start;
+  if (n == 0) return;
+  uint32_t id = block_id(bb_pc);
+  if (bb_count[id] == 0) touched[nr_touched ++] = id;
+  bb_count[id] += n;
+  bb_start = g_nr_guest_inst;
+}
+
+void simpoint_end_block(vaddr_t next_pc) {
+  account_block();
+  bb_pc = next_pc;
+}
+
+static void dump_interval() {
+  if (nr_touched == 0) return;
+  fputc('T', bbv_fp);
+  uint32_t i;
+  for (i = 0; i < nr_touched; i ++) {
+    uint32_t id = touched[i];
+    fprintf(bbv_fp, ":%u:%" PRIu64 " ", id, bb_count[id]);
+    bb_count[id] = 0;
+  }
+  fputc('\n', bbv_fp);
+  nr_touched = 0;
+}
+
+static void update_next_event() {
+  uint64_t ckpt = (ckpt_idx < nr_ckpt ? ckpt_inst[ckpt_idx] : -1);
+  simpoint_next_event = (ckpt < next_interval ? ckpt : next_interval);
+}
+
+void simpoint_event() {
+  if (g_nr_guest_inst == next_interval) {
+    // the current block is split at the boundary of the interval
+    account_block();
+    dump_interval();
+    next_interval += CONFIG_SIMPOINT_INTERVAL;
+  }
+
+#ifdef CONFIG_CHECKPOINT
+  while (ckpt_idx < nr_ckpt && ckpt_inst[ckpt_idx] == g_nr_guest_inst) {
+    char file[256];
+    snprintf(file, sizeof(file), "%s-%" PRIu64 ".ckpt", ckpt_prefix, g_nr_guest_inst);
+    checkpoint_save(file);
+    ckpt_idx ++;
+  }
+  if (ckpt_idx == nr_ckpt && nr_ckpt > 0 && !simpoint_bbv_enable) {
+    Log("All checkpoints are taken");
+    cpu_quit();
+  }
+#endif
+
+  update_next_event();
+}
+
+#ifdef CONFIG_CHECKPOINT
+static int cmp_inst(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+#endif
+
+void init_simpoint(const char *bbv_file, char *ckpt_list, const char *prefix) {
+  if (bbv_file != NULL) {
+    bbv_fp = fopen(bbv_file, "w");
+    Assert(bbv_fp, "Can not open '%s'", bbv_file);
+    table_grow();
+    bb_pc = cpu.pc;
+    bb_start = g_nr_guest_inst;
+    next_interval = g_nr_guest_inst + CONFIG_SIMPOINT_INTERVAL;
+    simpoint_bbv_enable = true;
+    Log("Basic block vectors are written to %s every %d instructions",
+        bbv_file, CONFIG_SIMPOINT_INTERVAL);
+  }
+
+#ifdef CONFIG_CHECKPOINT
+  if (ckpt_list != NULL) {
+    char *p;
+    for (p = strtok(ckpt_list, ","); p != NULL; p = strtok(NULL, ",")) {
+      ckpt_inst = realloc(ckpt_inst, sizeof(ckpt_inst[0]) * (nr_ckpt + 1));
+      assert(ckpt_inst);
+      ckpt_inst[nr_ckpt ++] = strtoull(p, NULL, 0);
+    }
+    qsort(ckpt_inst, nr_ckpt, sizeof(ckpt_inst[0]), cmp_inst);
+    // skip the points which have been passed, e.g. after restoring
+    while (ckpt_idx < nr_ckpt && ckpt_inst[ckpt_idx] <= g_nr_guest_inst) ckpt_idx ++;
+    ckpt_prefix = (prefix != NULL ? prefix : "nemu");
+  }
+#endif
+
+  update_next_event();
+}
+
+void simpoint_finish() {
+  if (bbv_fp == NULL) return;
+  account_block();
+  dump_interval();
+  fclose(bbv_fp);
+  bbv_fp = NULL;
+  simpoint_bbv_enable = false;
+  Log("%u basic blocks are profiled", nr_block);
+}
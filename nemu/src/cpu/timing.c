@@ -0,0 +1,82 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <cpu/timing.h>
+
+extern uint64_t g_nr_guest_inst;
+
+/* An approximate model of a single-issue in-order pipeline. Every
+ * instruction takes the latency of its class, and the stalls are added
+ * on top of it. Overlapping stalls are not modeled.
+ */
+
+const uint16_t timing_latency[NR_INST_CLASS] = {
+  [INST_ALU] = 1, [INST_LOAD] = 1, [INST_STORE] = 1, [INST_BRANCH] = 1, [INST_JUMP] = 1,
+  [INST_MUL] = CONFIG_TIMING_MUL_LATENCY, [INST_DIV] = CONFIG_TIMING_DIV_LATENCY,
+  [INST_SYSTEM] = 1,
+};
+
+uint64_t timing_cycles[NR_TIMING_CAUSE] = {};
+uint64_t timing_nr_load_use = 0;
+int timing_load_rd = 0;
+
+static uint64_t nr_branch_miss = 0;
+
+void timing_branch_miss() {
+  nr_branch_miss ++;
+  timing_cycles[TIMING_BRANCH] += CONFIG_TIMING_BRANCH_PENALTY;
+}
+
+#ifdef CONFIG_CACHE_SIM
+static uint64_t nr_l2_access = 0, nr_mem_access = 0;
+
+void timing_cache_miss(bool to_memory) {
+  if (to_memory) {
+    nr_mem_access ++;
+    timing_cycles[TIMING_CACHE] += CONFIG_TIMING_MEM_LATENCY;
+  } else {
+    nr_l2_access ++;
+    timing_cycles[TIMING_CACHE] += CONFIG_TIMING_L2_LATENCY;
+  }
+}
+#endif
+
+static inline double rate(uint64_t x, uint64_t total) {
+  return (total == 0 ? 0 : 100.0 * x / total);
+}
+
+void timing_dump() {
+  static const char *cause_name[NR_TIMING_CAUSE] = {
+    [TIMING_ISSUE] = "issue", [TIMING_LOAD_USE] = "load-use",
+    [TIMING_BRANCH] = "branch", [TIMING_CACHE] = "cache",
+  };
+  uint64_t total = 0;
+  int i;
+
+  for (i = 0; i < NR_TIMING_CAUSE; i ++) total += timing_cycles[i];
+  Log("timing model: %" PRIu64 " cycles for %" PRIu64 " instructions, CPI = %.3f",
+      total, g_nr_guest_inst, (g_nr_guest_inst == 0 ? 0 : (double)total / g_nr_guest_inst));
+  Log("estimated guest time at %d MHz = %.3f ms", CONFIG_TIMING_FREQ_MHZ,
+      total / (CONFIG_TIMING_FREQ_MHZ * 1000.0));
+  _Log("  %-9s %16s %7s\n", "cause", "cycles", "%");
+  for (i = 0; i < NR_TIMING_CAUSE; i ++) {
+    _Log("  %-9s %16" PRIu64 " %7.2f\n", cause_name[i], timing_cycles[i], rate(timing_cycles[i], total));
+  }
+  _Log("  load-use stalls = %" PRIu64 ", mispredicted branches = %" PRIu64 "\n",
+      timing_nr_load_use, nr_branch_miss);
+  IFDEF(CONFIG_CACHE_SIM, _Log("  L1 misses to L2 = %" PRIu64 ", accesses to the memory = %" PRIu64 "\n",
+      nr_l2_access, nr_mem_access));
+}
@@ -16,6 +16,7 @@
 #include <common.h>
 #include <utils.h>
 #include <device/alarm.h>
+#include <device/map.h>
 #ifndef CONFIG_TARGET_AM
 #include <SDL2/SDL.h>
 #endif
@@ -33,6 +34,10 @@ void init_alarm();
 void send_key(uint8_t, bool);
 void vga_update_screen();
 
+#ifdef CONFIG_DEVICE_STAT
+uint64_t vga_update_ns = 0;
+#endif
+
 void device_update() {
   static uint64_t last = 0;
   uint64_t now = get_time();
@@ -41,7 +46,13 @@ void device_update() {
   }
   last = now;
 
+#if defined(CONFIG_HAS_VGA) && defined(CONFIG_DEVICE_STAT)
+  uint64_t start = map_host_ns();
+  vga_update_screen();
+  vga_update_ns += map_host_ns() - start;
+#else
   IFDEF(CONFIG_HAS_VGA, vga_update_screen());
+#endif
 
 #ifndef CONFIG_TARGET_AM
   SDL_Event event;
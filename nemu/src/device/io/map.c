@@ -14,14 +14,19 @@
 ***************************************************************************************/
 
 #include <isa.h>
+#include <cpu/cpu.h>
 #include <memory/host.h>
 #include <memory/vaddr.h>
 #include <device/map.h>
+#include <time.h>
 
 #define IO_SPACE_MAX (2 * 1024 * 1024)
+#define NR_ALL_MAP 32
 
 static uint8_t *io_space = NULL;
 static uint8_t *p_space = NULL;
+static IOMap *all_maps[NR_ALL_MAP] = {};
+static int nr_all_map = 0;
 
 uint8_t* new_space(int size) {
   uint8_t *p = p_space;
@@ -32,18 +37,100 @@ uint8_t* new_space(int size) {
   return p;
 }
 
-static void check_bound(IOMap *map, paddr_t addr) {
-  if (map == NULL) {
-    Assert(map != NULL, "address (" FMT_PADDR ") is out of bound at pc = " FMT_WORD, addr, cpu.pc);
-  } else {
-    Assert(addr <= map->high && addr >= map->low,
-        "address (" FMT_PADDR ") is out of bound {%s} [" FMT_PADDR ", " FMT_PADDR "] at pc = " FMT_WORD,
-        addr, map->name, map->low, map->high, cpu.pc);
+#ifdef CONFIG_RT_CHECK
+// the callers only pass the map found for `addr`, so this is a sanity check
+static void check_bound(IOMap *map, paddr_t addr, int len) {
+  assert(len >= 1 && len <= 8);
+  Assert(addr <= map->high && addr >= map->low,
+      "address (" FMT_PADDR ") is out of bound {%s} [" FMT_PADDR ", " FMT_PADDR "] at pc = " FMT_WORD,
+      addr, map->name, map->low, map->high, cpu.pc);
+}
+#endif
+
+#ifdef CONFIG_DEVICE_STAT
+// a precise clock, since get_time() may be too coarse for a callback
+uint64_t map_host_ns() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+static void account(IOMap *map, int len, bool is_write) {
+  if (is_write) map->nr_write ++;
+  else map->nr_read ++;
+  map->bytes += len;
+}
+#endif
+
+#ifdef CONFIG_DTRACE
+/* With `--dtrace=FILE`, the accesses are buffered and written to FILE as
+ * DTraceRecord. The file starts with DTRACE_MAGIC, a byte of
+ * sizeof(word_t), a byte of the number of maps and their names ending
+ * with '\0', followed by the records. Replayed accesses are not traced.
+ */
+#define DTRACE_MAGIC "NEMUDTR1"
+#define NR_DTRACE_BUF 1024
+
+typedef struct __attribute__((packed)) {
+  word_t pc;
+  word_t addr;
+  word_t data;
+  uint8_t len_type; // len | type << 4, where type is 1 for reads and 2 for writes
+  uint8_t map;
+} DTraceRecord;
+
+static FILE *dtrace_fp = NULL;
+static DTraceRecord dtrace_buf[NR_DTRACE_BUF];
+static int nr_dtrace_buf = 0;
+
+static void dtrace_flush() {
+  fwrite(dtrace_buf, sizeof(dtrace_buf[0]), nr_dtrace_buf, dtrace_fp);
+  nr_dtrace_buf = 0;
+}
+
+static void dtrace(IOMap *map, paddr_t addr, int len, word_t data, bool is_write) {
+  if (dtrace_fp == NULL) return;
+  dtrace_buf[nr_dtrace_buf ++] = (DTraceRecord){ .pc = cpu.pc, .addr = addr, .data = data,
+    .len_type = len | ((is_write ? 2 : 1) << 4), .map = map->id };
+  if (nr_dtrace_buf == NR_DTRACE_BUF) dtrace_flush();
+}
+
+static void close_dtrace() {
+  dtrace_flush();
+  fclose(dtrace_fp);
+}
+
+void init_dtrace(const char *file) {
+  if (file == NULL) return;
+  dtrace_fp = fopen(file, "wb");
+  Assert(dtrace_fp, "Can not open '%s'", file);
+  uint8_t header[2] = { sizeof(word_t), nr_all_map };
+  int i;
+  fwrite(DTRACE_MAGIC, sizeof(DTRACE_MAGIC) - 1, 1, dtrace_fp);
+  fwrite(header, sizeof(header), 1, dtrace_fp);
+  for (i = 0; i < nr_all_map; i ++) {
+    fwrite(all_maps[i]->name, strlen(all_maps[i]->name) + 1, 1, dtrace_fp);
   }
+  atexit(close_dtrace);
+  Log("Trace the device accesses to %s", file);
+}
+#endif
+
+static void invoke_callback(IOMap *map, paddr_t offset, int len, bool is_write) {
+  if (map->callback == NULL) return;
+#ifdef CONFIG_DEVICE_STAT
+  uint64_t start = map_host_ns();
+  map->callback(offset, len, is_write);
+  map->callback_ns += map_host_ns() - start;
+#else
+  map->callback(offset, len, is_write);
+#endif
 }
 
-static void invoke_callback(io_callback_t c, paddr_t offset, int len, bool is_write) {
-  if (c != NULL) { c(offset, len, is_write); }
+void map_register(IOMap *map) {
+  assert(nr_all_map < NR_ALL_MAP);
+  map->id = nr_all_map;
+  all_maps[nr_all_map ++] = map;
 }
 
 void init_map() {
@@ -53,20 +140,47 @@ void init_map() {
 }
 
 word_t map_read(paddr_t addr, int len, IOMap *map) {
-  assert(len >= 1 && len <= 8);
-  check_bound(map, addr);
+  IFDEF(CONFIG_RT_CHECK, check_bound(map, addr, len));
   paddr_t offset = addr - map->low;
-  invoke_callback(map->callback, offset, len, false); // prepare data to read
+  invoke_callback(map, offset, len, false); // prepare data to read
   word_t ret = host_read(map->space + offset, len);
-  IFDEF(CONFIG_DTRACE, Log("address = " FMT_PADDR " read " FMT_PADDR " at device = %s", addr, ret, map->name));
+  IFDEF(CONFIG_DEVICE_STAT, if (likely(!g_replaying)) account(map, len, false));
+  IFDEF(CONFIG_DTRACE, if (likely(!g_replaying)) dtrace(map, addr, len, ret, false));
   return ret;
 }
 
 void map_write(paddr_t addr, int len, word_t data, IOMap *map) {
-  assert(len >= 1 && len <= 8);
-  check_bound(map, addr);
+  IFDEF(CONFIG_RT_CHECK, check_bound(map, addr, len));
   paddr_t offset = addr - map->low;
   host_write(map->space + offset, len, data);
-  invoke_callback(map->callback, offset, len, true);
-  IFDEF(CONFIG_DTRACE, Log("address = " FMT_PADDR " write " FMT_PADDR " at device = %s", addr, data, map->name));
+  invoke_callback(map, offset, len, true);
+  IFDEF(CONFIG_DEVICE_STAT, if (likely(!g_replaying)) account(map, len, true));
+  IFDEF(CONFIG_DTRACE, if (likely(!g_replaying)) dtrace(map, addr, len, data, true));
+}
+
+#ifdef CONFIG_DEVICE_STAT
+void device_stat_dump() {
+#ifdef CONFIG_HAS_VGA
+  extern uint64_t vga_nr_frame, vga_update_ns;
+  uint64_t frames = vga_nr_frame;
+#else
+  uint64_t frames = 0;
+#endif
+  int i;
+
+  Log("device accesses:");
+  _Log("  %-10s %12s %12s %14s %14s %12s\n", "device", "reads", "writes", "bytes",
+      "callback(ms)", "writes/frame");
+  for (i = 0; i < nr_all_map; i ++) {
+    IOMap *map = all_maps[i];
+    if (map->nr_read + map->nr_write == 0) continue;
+    char per_frame[32] = "-";
+    if (frames > 0) snprintf(per_frame, sizeof(per_frame), "%.1f", (double)map->nr_write / frames);
+    _Log("  %-10s %12" PRIu64 " %12" PRIu64 " %14" PRIu64 " %14.3f %12s\n", map->name,
+        map->nr_read, map->nr_write, map->bytes, map->callback_ns / 1e6, per_frame);
+  }
+#ifdef CONFIG_HAS_VGA
+  _Log("  %" PRIu64 " frames, %.3f ms in vga_update_screen()\n", frames, vga_update_ns / 1e6);
+#endif
 }
+#endif
@@ -13,8 +13,10 @@
 * See the Mulan PSL v2 for more details.
 ***************************************************************************************/
 
+#include <isa.h>
 #include <device/map.h>
 #include <memory/paddr.h>
+#include <memory/snapshot.h>
 
 #define NR_MAP 16
 
@@ -23,7 +25,9 @@ static int nr_map = 0;
 
 static IOMap* fetch_mmio_map(paddr_t addr) {
   int mapid = find_mapid_by_addr(maps, nr_map, addr);
-  return (mapid == -1 ? NULL : &maps[mapid]);
+  // the bound of an access is checked here once, not in map_read() or map_write()
+  Assert(mapid != -1, "address (" FMT_PADDR ") is out of bound at pc = " FMT_WORD, addr, cpu.pc);
+  return &maps[mapid];
 }
 
 static void report_mmio_overlap(const char *name1, paddr_t l1, paddr_t r1,
@@ -50,14 +54,19 @@ void add_mmio_map(const char *name, paddr_t addr, void *space, uint32_t len, io_
   Log("Add mmio map '%s' at [" FMT_PADDR ", " FMT_PADDR "]",
       maps[nr_map].name, maps[nr_map].low, maps[nr_map].high);
 
+  map_register(&maps[nr_map]);
+  IFDEF(CONFIG_SNAPSHOT, snapshot_add_state(name, space, len));
   nr_map ++;
 }
 
 /* bus interface */
 word_t mmio_read(paddr_t addr, int len) {
-  return map_read(addr, len, fetch_mmio_map(addr));
+  PERF_BEGIN(PERF_MMIO);
+  word_t ret = map_read(addr, len, fetch_mmio_map(addr));
+  PERF_END();
+  return ret;
 }
 
 void mmio_write(paddr_t addr, int len, word_t data) {
-  map_write(addr, len, data, fetch_mmio_map(addr));
+  PERF(PERF_MMIO, map_write(addr, len, data, fetch_mmio_map(addr)));
 }
@@ -14,6 +14,7 @@
 ***************************************************************************************/
 
 #include <device/map.h>
+#include <memory/snapshot.h>
 
 #define PORT_IO_SPACE_MAX 65535
 
@@ -30,6 +31,8 @@ void add_pio_map(const char *name, ioaddr_t addr, void *space, uint32_t len, io_
   Log("Add port-io map '%s' at [" FMT_PADDR ", " FMT_PADDR "]",
       maps[nr_map].name, maps[nr_map].low, maps[nr_map].high);
 
+  map_register(&maps[nr_map]);
+  IFDEF(CONFIG_SNAPSHOT, snapshot_add_state(name, space, len));
   nr_map ++;
 }
 
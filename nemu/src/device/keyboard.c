@@ -50,6 +50,10 @@ static void init_keymap() {
   MAP(_KEYS, SDL_KEYMAP)
 }
 
+/* The keys from the host which are not delivered to the guest yet. They are
+ * not a part of the guest state, so snapshots do not restore them, otherwise
+ * going back would deliver some keys twice and lose the newer ones.
+ */
 #define KEY_QUEUE_LEN 1024
 static int key_queue[KEY_QUEUE_LEN] = {};
 static int key_f = 0, key_r = 0;
@@ -60,7 +64,7 @@ static void key_enqueue(uint32_t am_scancode) {
   Assert(key_r != key_f, "key queue overflow!");
 }
 
-static uint32_t key_dequeue() {
+static uint64_t key_dequeue() {
   uint32_t key = _KEY_NONE;
   if (key_f != key_r) {
     key = key_queue[key_f];
@@ -78,7 +82,7 @@ void send_key(uint8_t scancode, bool is_keydown) {
 #else // !CONFIG_TARGET_AM
 #define _KEY_NONE 0
 
-static uint32_t key_dequeue() {
+static uint64_t key_dequeue() {
   AM_INPUT_KEYBRD_T ev = io_read(AM_INPUT_KEYBRD);
   uint32_t am_scancode = ev.keycode | (ev.keydown ? KEYDOWN_MASK : 0);
   return am_scancode;
@@ -90,7 +94,7 @@ static uint32_t *i8042_data_port_base = NULL;
 static void i8042_data_io_handler(uint32_t offset, int len, bool is_write) {
   assert(!is_write);
   assert(offset == 0);
-  i8042_data_port_base[0] = key_dequeue();
+  i8042_data_port_base[0] = MUXDEF(CONFIG_REPLAY, input_log(INPUT_KEY, key_dequeue), key_dequeue());
 }
 
 void init_i8042() {
@@ -14,6 +14,7 @@
 ***************************************************************************************/
 
 #include <device/map.h>
+#include <memory/snapshot.h>
 #include "mmc.h"
 
 // http://www.files.e-shop.co.il/pdastore/Tech-mmc-samsung/SEC%20MMC%20SPEC%20ver09.pdf
@@ -55,6 +56,13 @@ static void prepare_rw(int is_write) {
   write_cmd = is_write;
 }
 
+#ifdef CONFIG_SNAPSHOT
+static void sdcard_restore() {
+  // the contents of the image written after the snapshot are not restored
+  if (fp) fseek(fp, (blk_addr << 9) + addr, SEEK_SET);
+}
+#endif
+
 static void sdcard_handle_cmd(int cmd) {
   switch (cmd) {
     case MMC_GO_IDLE_STATE: break;
@@ -131,4 +139,13 @@ void init_sdcard() {
   const char *img = CONFIG_SDCARD_IMG_PATH;
   fp = fopen(img, "r+");
   if (fp == NULL) Log("Can not find sdcard image: %s", img);
+
+#ifdef CONFIG_SNAPSHOT
+  snapshot_add_state("sdhci.blkcnt", &blkcnt, sizeof(blkcnt));
+  snapshot_add_state("sdhci.blk_addr", &blk_addr, sizeof(blk_addr));
+  snapshot_add_state("sdhci.addr", &addr, sizeof(addr));
+  snapshot_add_state("sdhci.write_cmd", &write_cmd, sizeof(write_cmd));
+  snapshot_add_state("sdhci.read_ext_csd", &read_ext_csd, sizeof(read_ext_csd));
+  snapshot_add_callback(NULL, sdcard_restore);
+#endif
 }
@@ -14,6 +14,7 @@
 ***************************************************************************************/
 
 #include <utils.h>
+#include <cpu/cpu.h>
 #include <device/map.h>
 
 /* http://en.wikibooks.org/wiki/Serial_Programming/8250_UART_Programming */
@@ -25,6 +26,8 @@ static uint8_t *serial_base = NULL;
 
 
 static void serial_putc(char ch) {
+  // the characters are output once, not again when they are replayed
+  if (g_replaying) return;
   MUXDEF(CONFIG_TARGET_AM, putch(ch), putc(ch, stderr));
 }
 
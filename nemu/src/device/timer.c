@@ -22,7 +22,7 @@ static uint32_t *rtc_port_base = NULL;
 static void rtc_io_handler(uint32_t offset, int len, bool is_write) {
   assert(offset == 0 || offset == 4);
   if (!is_write && offset == 4) {
-    uint64_t us = get_time();
+    uint64_t us = MUXDEF(CONFIG_REPLAY, input_log(INPUT_RTC, get_time), get_time());
     rtc_port_base[0] = (uint32_t)us;
     rtc_port_base[1] = us >> 32;
   }
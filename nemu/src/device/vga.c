@@ -14,6 +14,7 @@
 ***************************************************************************************/
 
 #include <common.h>
+#include <cpu/cpu.h>
 #include <device/map.h>
 
 #define SCREEN_W (MUXDEF(CONFIG_VGA_SIZE_800x600, 800, 400))
@@ -70,11 +71,19 @@ static inline void update_screen() {
 #endif
 #endif
 
+#ifdef CONFIG_DEVICE_STAT
+uint64_t vga_nr_frame = 0;
+#endif
+
 void vga_update_screen() {
   // TODO: call `update_screen()` when the sync register is non-zero,
   // then zero out the sync register
   if (vgactl_port_base[1] & 0x1){
-    update_screen();
+    // the replayed frames are not shown, but the guest still sees the sync
+    if (!g_replaying) {
+      update_screen();
+      IFDEF(CONFIG_DEVICE_STAT, vga_nr_frame ++);
+    }
     vgactl_port_base[1] = 0;
   }
 }
@@ -17,6 +17,7 @@
 #include <cpu/cpu.h>
 #include <cpu/ifetch.h>
 #include <cpu/decode.h>
+#include <cpu/watchpoint.h>
 
 #define R(i) gpr(i)
 #define Mr vaddr_read
@@ -50,6 +51,8 @@ static int decode_exec(Decode *s) {
 #define INSTPAT_MATCH(s, name, type, ... /* execute body */ ) { \
   decode_operand(s, &rd, &src1, &src2, &imm, concat(TYPE_, type)); \
   __VA_ARGS__ ; \
+  /* stores are included as well, a watchpoint only stops on a change */ \
+  IFDEF(CONFIG_WATCHPOINT, if (concat(TYPE_, type) != TYPE_N) wp_track_reg(rd)); \
 }
 
   INSTPAT_START();
@@ -26,6 +26,18 @@ const char *regs[] = {
 void isa_reg_display() {
 }
 
+const word_t *isa_reg_str2ptr(const char *s) {
+  if (strcmp(s, "$pc") == 0) return &cpu.pc;
+
+  for (int i = 0; i < 32; i++) {
+    // "$0" already carries its '$'
+    if (strcmp(i == 0 ? s : s + 1, regs[i]) == 0) return &cpu.gpr[i];
+  }
+  return NULL;
+}
+
 word_t isa_reg_str2val(const char *s, bool *success) {
-  return 0;
+  const word_t *reg = isa_reg_str2ptr(s);
+  *success = (reg != NULL);
+  return (reg != NULL ? *reg : 0);
 }
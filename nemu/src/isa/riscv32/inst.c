@@ -17,6 +17,13 @@
 #include <cpu/cpu.h>
 #include <cpu/ifetch.h>
 #include <cpu/decode.h>
+#include <cpu/watchpoint.h>
+#include <cpu/inst-stat.h>
+#include <cpu/profile.h>
+#include <memory/cache.h>
+#include <memory/mtrace.h>
+#include <cpu/bpred.h>
+#include <cpu/timing.h>
 
 #ifdef CONFIG_FTRACE
   #include <ftrace.h>
@@ -42,8 +49,26 @@
 
 
 #define R(i) gpr(i)
+// the destination register decoded by decode_operand()
+#define Rd (*dest)
+#if defined(CONFIG_CACHE_SIM) || defined(CONFIG_MTRACE)
+// only the accesses of the guest go through the caches and the trace, not those of sdb
+static inline word_t Mr(vaddr_t addr, int len) {
+  IFDEF(CONFIG_CACHE_SIM, if (likely(!g_replaying)) cache_data(addr, len, false));
+  word_t data = vaddr_read(addr, len);
+  IFDEF(CONFIG_MTRACE, mtrace_access(MTRACE_READ, addr, len, data));
+  return data;
+}
+
+static inline void Mw(vaddr_t addr, int len, word_t data) {
+  IFDEF(CONFIG_CACHE_SIM, if (likely(!g_replaying)) cache_data(addr, len, true));
+  IFDEF(CONFIG_MTRACE, mtrace_access(MTRACE_WRITE, addr, len, data));
+  vaddr_write(addr, len, data);
+}
+#else
 #define Mr vaddr_read
 #define Mw vaddr_write
+#endif
 
 enum {
   TYPE_I, TYPE_U, TYPE_S, TYPE_J, TYPE_R, TYPE_B, TYPE_SH,
@@ -59,11 +84,15 @@ enum {
 #define immB() do { *imm = (SEXT(BITS(i, 31, 31), 1) << 12) | (BITS(i, 30, 25) << 5) | (BITS(i, 11, 8) <<   1) |(BITS(i,  7,  7) << 11);} while(0)
 #define immSH()   { *imm = rs2;} //shamt
 
-static void decode_operand(Decode *s, int *rd, word_t *src1, word_t *src2, word_t *imm, int type) {
+// writes to $zero go to this slot, so that $zero need not be reset after every instruction
+static word_t zero_sink = 0;
+
+static void decode_operand(Decode *s, int *rd, word_t **dest, word_t *src1, word_t *src2, word_t *imm, int type) {
   uint32_t i = s->isa.inst.val;
   int rs1 = BITS(i, 19, 15);
   int rs2 = BITS(i, 24, 20);
   *rd     = BITS(i, 11, 7);
+  *dest   = (*rd == 0 ? &zero_sink : &R(*rd));
   switch (type) {
     case TYPE_I: src1R();          immI(); break;
     case TYPE_U:                   immU(); break;
@@ -75,20 +104,92 @@ static void decode_operand(Decode *s, int *rd, word_t *src1, word_t *src2, word_
   }
 }
 
+static inline bool writes_rd(int type) {
+  return type != TYPE_S && type != TYPE_B && type != TYPE_N;
+}
+
+#if defined(CONFIG_INST_STAT) || defined(CONFIG_TIMING)
+static int inst_class(uint32_t i) {
+  switch (BITS(i, 6, 0)) {
+    case 0x03: return INST_LOAD;
+    case 0x23: return INST_STORE;
+    case 0x63: return INST_BRANCH;
+    case 0x67: case 0x6f: return INST_JUMP;
+    case 0x73: return INST_SYSTEM;
+    case 0x33:
+      if (BITS(i, 31, 25) == 1) return (BITS(i, 14, 12) < 4 ? INST_MUL : INST_DIV);
+      return INST_ALU;
+    default: return INST_ALU;
+  }
+}
+#endif
+
+// keep the shadow call stack of the profiler by the calling convention
+#define PROFILE_JAL() IFDEF(CONFIG_PROFILE, if (rd == 1) profile_call(s->dnpc))
+#define PROFILE_JALR() IFDEF(CONFIG_PROFILE, \
+  if (rd == 1) profile_call(s->dnpc); \
+  else if (rd == 0 && BITS(s->isa.inst.val, 19, 15) == 1) profile_ret())
+
+#ifdef CONFIG_BPRED
+static inline void bpred_cond(Decode *s) {
+  BranchInfo b = { .pc = s->pc, .snpc = s->snpc, .target = s->dnpc,
+    .kind = BR_COND, .taken = (s->dnpc != s->snpc) };
+  bpred_branch(&b);
+}
+
+// classify jal and jalr by the calling convention
+static inline void bpred_jump(Decode *s, int rd, bool indirect) {
+  int rs1 = BITS(s->isa.inst.val, 19, 15);
+  BranchInfo b = { .pc = s->pc, .snpc = s->snpc, .target = s->dnpc, .taken = true,
+    .kind = (!indirect ? BR_DIRECT : (rd == 0 && rs1 == 1 ? BR_RET : BR_INDIRECT)),
+    .call = (rd == 1) };
+  bpred_branch(&b);
+}
+#endif
+
+#ifdef CONFIG_TIMING
+static inline void timing_exec(Decode *s, int type, int rd) {
+  uint32_t i = s->isa.inst.val;
+  bool read1 = (type == TYPE_I || type == TYPE_S || type == TYPE_R || type == TYPE_B || type == TYPE_SH);
+  bool read2 = (type == TYPE_S || type == TYPE_R || type == TYPE_B);
+  timing_inst(inst_class(i), (writes_rd(type) ? rd : 0),
+      (read1 ? BITS(i, 19, 15) : 0), (read2 ? BITS(i, 24, 20) : 0));
+#ifndef CONFIG_BPRED
+  // predict backward branches taken and forward branches not taken, and
+  // always miss the target of jalr
+  if (type == TYPE_B) {
+    if ((s->dnpc != s->snpc) != BITS(i, 31, 31)) timing_branch_miss();
+  } else if (BITS(i, 6, 0) == 0x67) timing_branch_miss();
+#endif
+}
+#endif
+
+#define BPRED_JUMP(indirect) IFDEF(CONFIG_BPRED, if (likely(!g_replaying)) bpred_jump(s, rd, indirect))
+
 static int decode_exec(Decode *s) {
   int rd = 0;
+  word_t *dest = &zero_sink;
   word_t src1 = 0, src2 = 0, imm = 0;
   s->dnpc = s->snpc;
+  PERF_BEGIN(PERF_DECODE);
 
 #define INSTPAT_INST(s) ((s)->isa.inst.val)
 #define INSTPAT_MATCH(s, name, type, ... /* execute body */ ) { \
-  decode_operand(s, &rd, &src1, &src2, &imm, concat(TYPE_, type)); \
+  PERF_END(); \
+  decode_operand(s, &rd, &dest, &src1, &src2, &imm, concat(TYPE_, type)); \
   __VA_ARGS__ ; \
+  IFDEF(CONFIG_WATCHPOINT, if (writes_rd(concat(TYPE_, type))) wp_track_reg(rd)); \
+  if (likely(!g_replaying)) { \
+    IFDEF(CONFIG_INST_STAT, INST_STAT(s, name, inst_class(s->isa.inst.val))); \
+    IFDEF(CONFIG_BPRED, if (concat(TYPE_, type) == TYPE_B) bpred_cond(s)); \
+    IFDEF(CONFIG_TIMING, timing_exec(s, concat(TYPE_, type), rd)); \
+  } \
 }
 
 #ifdef CONFIG_FTRACE
 
-#define FTRACEJAL(s) { \
+// the calls and returns are printed once, not again when they are replayed
+#define FTRACEJAL(s) if (likely(!g_replaying)) { \
   vaddr_t now_pc = s->pc;\
   vaddr_t next_pc = imm + s->pc;\
   const char *name =  get_func_name(next_pc);\
@@ -104,7 +205,7 @@ static int decode_exec(Decode *s) {
   print_tabnum++;\
 }
 
-#define FTRACEJALR(s) { \
+#define FTRACEJALR(s) if (likely(!g_replaying)) { \
   vaddr_t now_pc = s->pc;\
   vaddr_t next_pc = (src1 + imm) & (~1);\
   uint32_t i = s->isa.inst.val;\
@@ -139,37 +240,37 @@ static int decode_exec(Decode *s) {
 
 
   INSTPAT_START();
-  INSTPAT("??????? ????? ????? ??? ????? 01101 11", lui    , U, R(rd) = imm);
-  INSTPAT("??????? ????? ????? ??? ????? 00101 11", auipc  , U, R(rd) = imm + s->pc);
-
-  INSTPAT("??????? ????? ????? 010 ????? 00000 11", lw     , I, R(rd) = Mr(src1 + imm, 4));
-  INSTPAT("??????? ????? ????? 001 ????? 00000 11", lh     , I, R(rd) = SEXT(Mr(src1 + imm, 2), 16));
-  INSTPAT("??????? ????? ????? 000 ????? 00000 11", lb     , I, R(rd) = SEXT(Mr(src1 + imm, 1), 8));
-  INSTPAT("??????? ????? ????? 101 ????? 00000 11", lhu    , I, R(rd) = Mr(src1 + imm, 2));
-  INSTPAT("??????? ????? ????? 100 ????? 00000 11", lbu    , I, R(rd) = Mr(src1 + imm, 1));
-  INSTPAT("??????? ????? ????? 000 ????? 00100 11", addi   , I, R(rd) = src1 + imm);
+  INSTPAT("??????? ????? ????? ??? ????? 01101 11", lui    , U, Rd = imm);
+  INSTPAT("??????? ????? ????? ??? ????? 00101 11", auipc  , U, Rd = imm + s->pc);
+
+  INSTPAT("??????? ????? ????? 010 ????? 00000 11", lw     , I, Rd = Mr(src1 + imm, 4));
+  INSTPAT("??????? ????? ????? 001 ????? 00000 11", lh     , I, Rd = SEXT(Mr(src1 + imm, 2), 16));
+  INSTPAT("??????? ????? ????? 000 ????? 00000 11", lb     , I, Rd = SEXT(Mr(src1 + imm, 1), 8));
+  INSTPAT("??????? ????? ????? 101 ????? 00000 11", lhu    , I, Rd = Mr(src1 + imm, 2));
+  INSTPAT("??????? ????? ????? 100 ????? 00000 11", lbu    , I, Rd = Mr(src1 + imm, 1));
+  INSTPAT("??????? ????? ????? 000 ????? 00100 11", addi   , I, Rd = src1 + imm);
 #ifdef CONFIG_FTRACE
-  INSTPAT("??????? ????? ????? 000 ????? 11001 11", jalr   , I, FTRACEJALR(s); s->dnpc = (src1 + imm) & (~1); R(rd) = s->pc + 4);
+  INSTPAT("??????? ????? ????? 000 ????? 11001 11", jalr   , I, FTRACEJALR(s); s->dnpc = (src1 + imm) & (~1); Rd = s->pc + 4; PROFILE_JALR(); BPRED_JUMP(true));
 #else
-  INSTPAT("??????? ????? ????? 000 ????? 11001 11", jalr   , I, s->dnpc = (src1 + imm) & (~1); R(rd) = s->pc + 4);
+  INSTPAT("??????? ????? ????? 000 ????? 11001 11", jalr   , I, s->dnpc = (src1 + imm) & (~1); Rd = s->pc + 4; PROFILE_JALR(); BPRED_JUMP(true));
 #endif
-  INSTPAT("??????? ????? ????? 011 ????? 00100 11", sltiu  , I, R(rd) = (src1  < imm ? 1 : 0));
-  INSTPAT("0000000 ????? ????? 001 ????? 00100 11", slli   ,SH, R(rd) = (src1 << imm));
-  INSTPAT("??????? ????? ????? 111 ????? 00100 11", andi   , I, R(rd) = (src1  & imm));
-  INSTPAT("0000000 ????? ????? 101 ????? 00100 11", srli   ,SH, R(rd) = (src1 >> imm));
-  INSTPAT("0100000 ????? ????? 101 ????? 00100 11", srai   ,SH, R(rd) = ((sword_t)(src1) >> (sword_t)imm));
-  INSTPAT("??????? ????? ????? 100 ????? 00100 11", xori   , I, R(rd) = src1 ^ imm);
-  INSTPAT("??????? ????? ????? 110 ????? 00100 11", ori    , I, R(rd) = src1 | imm);
-  INSTPAT("??????? ????? ????? 010 ????? 00100 11", slti   , I, R(rd) = (sword_t)src1 < (sword_t)imm ? 1 : 0);
+  INSTPAT("??????? ????? ????? 011 ????? 00100 11", sltiu  , I, Rd = (src1  < imm ? 1 : 0));
+  INSTPAT("0000000 ????? ????? 001 ????? 00100 11", slli   ,SH, Rd = (src1 << imm));
+  INSTPAT("??????? ????? ????? 111 ????? 00100 11", andi   , I, Rd = (src1  & imm));
+  INSTPAT("0000000 ????? ????? 101 ????? 00100 11", srli   ,SH, Rd = (src1 >> imm));
+  INSTPAT("0100000 ????? ????? 101 ????? 00100 11", srai   ,SH, Rd = ((sword_t)(src1) >> (sword_t)imm));
+  INSTPAT("??????? ????? ????? 100 ????? 00100 11", xori   , I, Rd = src1 ^ imm);
+  INSTPAT("??????? ????? ????? 110 ????? 00100 11", ori    , I, Rd = src1 | imm);
+  INSTPAT("??????? ????? ????? 010 ????? 00100 11", slti   , I, Rd = (sword_t)src1 < (sword_t)imm ? 1 : 0);
 
   INSTPAT("??????? ????? ????? 010 ????? 01000 11", sw     , S, Mw(src1 + imm, 4, src2));
   INSTPAT("??????? ????? ????? 000 ????? 01000 11", sb     , S, Mw(src1 + imm, 1, src2));
   INSTPAT("??????? ????? ????? 001 ????? 01000 11", sh     , S, Mw(src1 + imm, 2, src2));
 
 #ifdef CONFIG_FTRACE
-  INSTPAT("??????? ????? ????? ??? ????? 11011 11", jal    , J, s->dnpc = s->pc + imm; R(rd) = s->pc + 4; FTRACEJAL(s));
+  INSTPAT("??????? ????? ????? ??? ????? 11011 11", jal    , J, s->dnpc = s->pc + imm; Rd = s->pc + 4; FTRACEJAL(s); PROFILE_JAL(); BPRED_JUMP(false));
 #else
-  INSTPAT("??????? ????? ????? ??? ????? 11011 11", jal    , J, s->dnpc = s->pc + imm; R(rd) = s->pc + 4);
+  INSTPAT("??????? ????? ????? ??? ????? 11011 11", jal    , J, s->dnpc = s->pc + imm; Rd = s->pc + 4; PROFILE_JAL(); BPRED_JUMP(false));
 #endif
 
   INSTPAT("??????? ????? ????? 101 ????? 11000 11", bge    , B, if ((sword_t)(src1) >= (sword_t)(src2)){s->dnpc = imm + s->pc;});
@@ -180,30 +281,29 @@ static int decode_exec(Decode *s) {
   INSTPAT("??????? ????? ????? 000 ????? 11000 11", beq    , B, if(src1 == src2) {s->dnpc = imm + s->pc;});
 
 
-  INSTPAT("0000000 ????? ????? 000 ????? 01100 11", add    , R, R(rd) = src1 + src2);
-  INSTPAT("0100000 ????? ????? 000 ????? 01100 11", sub    , R, R(rd) = src1 - src2);
-  INSTPAT("0000001 ????? ????? 000 ????? 01100 11", mul    , R, R(rd) = src1 * src2);
-  INSTPAT("0000001 ????? ????? 001 ????? 01100 11", mulh   , R, R(rd) = (sword_t)((SEXT((long long)src1, 32) * SEXT((long long)src2, 32)) >> 32));
-  INSTPAT("0000001 ????? ????? 011 ????? 01100 11", mulhu  , R, R(rd) = ((long long)src1 * (long long)src2) >> 32);
-  INSTPAT("0000001 ????? ????? 100 ????? 01100 11", div    , R, R(rd) = (sword_t)src1/(sword_t)src2);
-  INSTPAT("0000001 ????? ????? 101 ????? 01100 11", divu   , R, R(rd) = src1 / src2);
-  INSTPAT("0000001 ????? ????? 110 ????? 01100 11", rem    , R, R(rd) = (sword_t)src1 % (sword_t)src2);
-  INSTPAT("0000001 ????? ????? 111 ????? 01100 11", remu   , R, R(rd) = src1 % src2);
-  INSTPAT("0100000 ????? ????? 101 ????? 01100 11", sra    , R, R(rd) = (sword_t)src1 >> (sword_t)src2);
-  INSTPAT("0000000 ????? ????? 101 ????? 01100 11", srl    , R, R(rd) = (src1 >> src2));
-  INSTPAT("0000000 ????? ????? 001 ????? 01100 11", sll    , R, R(rd) = (src1 << src2));
-  INSTPAT("0000000 ????? ????? 010 ????? 01100 11", slt    , R, R(rd) = ((sword_t)src1 < (sword_t)src2 ? 1 : 0));
-  INSTPAT("0000000 ????? ????? 011 ????? 01100 11", sltu   , R, R(rd) = src1 < src2 ? 1 : 0);
-  INSTPAT("0000000 ????? ????? 100 ????? 01100 11", xor    , R, R(rd) = (src1 ^ src2));
-  INSTPAT("0000000 ????? ????? 110 ????? 01100 11", or     , R, R(rd) = (src1 | src2));
-  INSTPAT("0000000 ????? ????? 111 ????? 01100 11", and    , R, R(rd) = src1 & src2);
+  INSTPAT("0000000 ????? ????? 000 ????? 01100 11", add    , R, Rd = src1 + src2);
+  INSTPAT("0100000 ????? ????? 000 ????? 01100 11", sub    , R, Rd = src1 - src2);
+  INSTPAT("0000001 ????? ????? 000 ????? 01100 11", mul    , R, Rd = src1 * src2);
+  INSTPAT("0000001 ????? ????? 001 ????? 01100 11", mulh   , R, Rd = (sword_t)((SEXT((long long)src1, 32) * SEXT((long long)src2, 32)) >> 32));
+  INSTPAT("0000001 ????? ????? 011 ????? 01100 11", mulhu  , R, Rd = ((long long)src1 * (long long)src2) >> 32);
+  INSTPAT("0000001 ????? ????? 100 ????? 01100 11", div    , R, Rd = (sword_t)src1/(sword_t)src2);
+  INSTPAT("0000001 ????? ????? 101 ????? 01100 11", divu   , R, Rd = src1 / src2);
+  INSTPAT("0000001 ????? ????? 110 ????? 01100 11", rem    , R, Rd = (sword_t)src1 % (sword_t)src2);
+  INSTPAT("0000001 ????? ????? 111 ????? 01100 11", remu   , R, Rd = src1 % src2);
+  INSTPAT("0100000 ????? ????? 101 ????? 01100 11", sra    , R, Rd = (sword_t)src1 >> (sword_t)src2);
+  INSTPAT("0000000 ????? ????? 101 ????? 01100 11", srl    , R, Rd = (src1 >> src2));
+  INSTPAT("0000000 ????? ????? 001 ????? 01100 11", sll    , R, Rd = (src1 << src2));
+  INSTPAT("0000000 ????? ????? 010 ????? 01100 11", slt    , R, Rd = ((sword_t)src1 < (sword_t)src2 ? 1 : 0));
+  INSTPAT("0000000 ????? ????? 011 ????? 01100 11", sltu   , R, Rd = src1 < src2 ? 1 : 0);
+  INSTPAT("0000000 ????? ????? 100 ????? 01100 11", xor    , R, Rd = (src1 ^ src2));
+  INSTPAT("0000000 ????? ????? 110 ????? 01100 11", or     , R, Rd = (src1 | src2));
+  INSTPAT("0000000 ????? ????? 111 ????? 01100 11", and    , R, Rd = src1 & src2);
 
 
   INSTPAT("0000000 00001 00000 000 00000 11100 11", ebreak , N, NEMUTRAP(s->pc, R(10))); // R(10) is $a0
   INSTPAT("??????? ????? ????? ??? ????? ????? ??", inv    , N, INV(s->pc));
   INSTPAT_END();
 
-  R(0) = 0; // reset $zero to 0
   return 0;
 }
 
@@ -31,9 +31,10 @@ void isa_reg_display() {
   printf("$pc\t0x%08x\n", cpu.pc);
 }
 
-word_t isa_reg_str2val(const char *s, bool *success) {
+const word_t *isa_reg_str2ptr(const char *s) {
   int i;
-  *success = false;
+
+  if (strcmp(s, "$pc") == 0) return &cpu.pc;
 
   for (i = 0; i < 32; i++) {
     const char *reg;
@@ -43,9 +44,14 @@ word_t isa_reg_str2val(const char *s, bool *success) {
       reg = s + 1;
     }
 		if (strcmp(reg, *(regs + i)) == 0) {
-			*success = true;
-			return cpu.gpr[i];
+			return &cpu.gpr[i];
 		}
 	}
-  return 0;
+  return NULL;
+}
+
+word_t isa_reg_str2val(const char *s, bool *success) {
+  const word_t *reg = isa_reg_str2ptr(s);
+  *success = (reg != NULL);
+  return (reg != NULL ? *reg : 0);
 }
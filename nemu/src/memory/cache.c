@@ -0,0 +1,298 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <memory/cache.h>
+#include <memory/paddr.h>
+#include <ftrace.h>
+#include <cpu/timing.h>
+
+/* A set associative cache. A line is packed into one word as
+ *   block number << 2 | dirty << 1 | valid
+ * so that a set is searched by comparing words. The ways of a set are
+ * kept from the newest to the oldest for LRU and FIFO.
+ */
+
+#define LINE_VALID 1ull
+#define LINE_DIRTY 2ull
+
+// the index and the tag of a block are taken by masks and shifts
+#define IS_POW2(x) ((x) > 0 && ((x) & ((x) - 1)) == 0)
+#define NR_SET(size_kb, ways) ((size_kb) * 1024 / CONFIG_CACHE_LINE_SIZE / (ways))
+
+static_assert(IS_POW2(CONFIG_CACHE_LINE_SIZE), "CACHE_LINE_SIZE must be a power of 2");
+static_assert(IS_POW2(NR_SET(CONFIG_CACHE_L1I_SIZE, CONFIG_CACHE_L1I_WAYS)),
+    "the number of sets of L1I must be a power of 2");
+static_assert(IS_POW2(NR_SET(CONFIG_CACHE_L1D_SIZE, CONFIG_CACHE_L1D_WAYS)),
+    "the number of sets of L1D must be a power of 2");
+static_assert(CONFIG_CACHE_L2_SIZE == 0 || IS_POW2(NR_SET(CONFIG_CACHE_L2_SIZE, CONFIG_CACHE_L2_WAYS)),
+    "the number of sets of L2 must be a power of 2");
+
+enum { L1I, L1D, L2, NR_LEVEL };
+
+typedef struct {
+  const char *name;
+  uint64_t *lines;
+  uint32_t set_mask;
+  int ways;
+  uint64_t access, miss, writeback;
+} Cache;
+
+// the counters attributed to an instruction line, for the report by function
+typedef struct {
+  uint64_t block;
+  uint64_t access[NR_LEVEL], miss[NR_LEVEL];
+} LineStat;
+
+static Cache caches[NR_LEVEL] = {
+  [L1I] = { .name = "L1I" }, [L1D] = { .name = "L1D" }, [L2] = { .name = "L2" },
+};
+static uint64_t mem_read = 0, mem_write = 0;
+
+uint64_t cache_last_iblock = -1;
+uint64_t cache_ifetch_batched = 0;
+
+static LineStat total = {};
+static LineStat *cur = &total;
+static LineStat *line_table = NULL; // open addressing, access[L1I] == 0 means empty
+static uint32_t line_mask = 0, nr_line = 0;
+static bool by_function = false;
+static uint32_t rand_state = 1;
+
+// a private generator, so that the random numbers of the guest are intact
+static inline uint32_t xorshift() {
+  rand_state ^= rand_state << 13;
+  rand_state ^= rand_state >> 17;
+  rand_state ^= rand_state << 5;
+  return rand_state;
+}
+
+static void cache_init_level(Cache *c, int size_kb, int ways) {
+  uint32_t nr_set = NR_SET(size_kb, ways);
+  c->lines = calloc(nr_set * ways, sizeof(c->lines[0]));
+  assert(c->lines);
+  c->set_mask = nr_set - 1;
+  c->ways = ways;
+}
+
+static bool level_enabled(int level) {
+  return caches[level].lines != NULL;
+}
+
+/* Look up `block` in `c`. On a miss, the line is allocated if `alloc`, and
+ * the block of an evicted dirty line is returned by `victim`.
+ */
+static bool lookup(Cache *c, uint64_t block, bool write, bool alloc, uint64_t *victim) {
+  uint64_t *set = c->lines + (block & c->set_mask) * c->ways;
+  uint64_t key = (block << 2) | LINE_VALID;
+  uint64_t dirty = (write && ISDEF(CONFIG_CACHE_WRITE_BACK) ? LINE_DIRTY : 0);
+  int i;
+
+  *victim = -1;
+  for (i = 0; i < c->ways; i ++) {
+    if ((set[i] & ~LINE_DIRTY) == key) {
+      uint64_t line = set[i] | dirty;
+      if (ISDEF(CONFIG_CACHE_REPL_LRU) && i > 0) {
+        memmove(set + 1, set, sizeof(set[0]) * i);
+        i = 0;
+      }
+      set[i] = line;
+      return true;
+    }
+  }
+
+  if (!alloc) return false;
+
+  int w = MUXDEF(CONFIG_CACHE_REPL_RANDOM, xorshift() % c->ways, c->ways - 1);
+  if ((set[w] & (LINE_VALID | LINE_DIRTY)) == (LINE_VALID | LINE_DIRTY)) {
+    *victim = set[w] >> 2;
+    c->writeback ++;
+  }
+#ifndef CONFIG_CACHE_REPL_RANDOM
+  memmove(set + 1, set, sizeof(set[0]) * w);
+  w = 0;
+#endif
+  set[w] = key | dirty;
+  return false;
+}
+
+static void access_level(int level, uint64_t block, bool write) {
+  if (level == NR_LEVEL || !level_enabled(level)) {
+    if (write) mem_write ++;
+    else mem_read ++;
+    return;
+  }
+
+  Cache *c = &caches[level];
+  int next = (level == L2 ? NR_LEVEL : L2);
+  // write-through caches do not allocate lines on write misses
+  bool alloc = !(write && ISDEF(CONFIG_CACHE_WRITE_THROUGH));
+  uint64_t victim;
+
+  c->access ++;
+  cur->access[level] ++;
+  bool hit = lookup(c, block, write, alloc, &victim);
+  if (!hit) {
+    c->miss ++;
+    cur->miss[level] ++;
+    if (alloc) {
+      // only the fills for the guest stall, not those for the writebacks to L2
+      IFDEF(CONFIG_TIMING, if (level != L2 || !write)
+          timing_cache_miss(next == NR_LEVEL || !level_enabled(next)));
+      access_level(next, block, false);
+    }
+  }
+  if (victim != -1) access_level(next, victim, true);
+  if (write && ISDEF(CONFIG_CACHE_WRITE_THROUGH)) access_level(next, block, true);
+}
+
+static inline uint32_t hash_block(uint64_t block) {
+  return (uint32_t)(block * 0x9e3779b1u);
+}
+
+static LineStat *line_lookup(LineStat *table, uint32_t mask, uint64_t block) {
+  uint32_t i;
+  for (i = hash_block(block) & mask; table[i].access[L1I] != 0 && table[i].block != block;
+      i = (i + 1) & mask);
+  return &table[i];
+}
+
+static void line_grow() {
+  LineStat *old = line_table;
+  uint32_t old_size = (old == NULL ? 0 : line_mask + 1);
+  uint32_t size = (old == NULL ? 4096 : old_size * 2), i;
+
+  line_table = calloc(size, sizeof(line_table[0]));
+  assert(line_table);
+  line_mask = size - 1;
+  for (i = 0; i < old_size; i ++) {
+    if (old[i].access[L1I] != 0) *line_lookup(line_table, line_mask, old[i].block) = old[i];
+  }
+  free(old);
+}
+
+static void flush_batched() {
+  caches[L1I].access += cache_ifetch_batched;
+  cur->access[L1I] += cache_ifetch_batched;
+  cache_ifetch_batched = 0;
+}
+
+void cache_ifetch_block(uint64_t block) {
+  flush_batched();
+  cache_last_iblock = block;
+
+  if (by_function) {
+    // `cur` may move when the table grows, and is looked up again
+    if ((nr_line + 1) * 2 > line_mask + 1) line_grow();
+    cur = line_lookup(line_table, line_mask, block);
+    if (cur->access[L1I] == 0) {
+      cur->block = block;
+      nr_line ++;
+    }
+  }
+  access_level(L1I, block, false);
+}
+
+void cache_data(paddr_t addr, int len, bool is_write) {
+  if (!in_pmem(addr)) return; // MMIO is not cached
+  uint64_t block = addr >> CACHE_LINE_SHIFT;
+  access_level(L1D, block, is_write);
+  // an access across two lines
+  uint64_t last = (addr + len - 1) >> CACHE_LINE_SHIFT;
+  if (unlikely(last != block)) access_level(L1D, last, is_write);
+}
+
+void init_cache() {
+  cache_init_level(&caches[L1I], CONFIG_CACHE_L1I_SIZE, CONFIG_CACHE_L1I_WAYS);
+  cache_init_level(&caches[L1D], CONFIG_CACHE_L1D_SIZE, CONFIG_CACHE_L1D_WAYS);
+  if (CONFIG_CACHE_L2_SIZE > 0) {
+    cache_init_level(&caches[L2], CONFIG_CACHE_L2_SIZE, CONFIG_CACHE_L2_WAYS);
+  }
+  by_function = (num_functions > 0);
+  if (by_function) line_grow();
+}
+
+static inline double rate(uint64_t x, uint64_t total) {
+  return (total == 0 ? 0 : 100.0 * x / total);
+}
+
+typedef struct {
+  int func;
+  uint64_t access[NR_LEVEL], miss[NR_LEVEL];
+} FuncStat;
+
+static int cmp_miss(const void *a, const void *b) {
+  const FuncStat *x = a, *y = b;
+  uint64_t mx = x->miss[L1I] + x->miss[L1D], my = y->miss[L1I] + y->miss[L1D];
+  return (mx < my) - (mx > my);
+}
+
+#define TOP_N 20
+
+static void dump_by_function() {
+  FuncStat *funcs = calloc(num_functions + 1, sizeof(funcs[0]));
+  uint32_t i;
+  int l;
+
+  assert(funcs);
+  for (i = 0; i <= num_functions; i ++) funcs[i].func = i;
+  for (i = 0; i <= line_mask; i ++) {
+    LineStat *ls = &line_table[i];
+    if (ls->access[L1I] == 0) continue;
+    // a line shared by two functions is attributed to the first one
+    int f = find_function(ls->block << CACHE_LINE_SHIFT);
+    if (f < 0) f = find_function(((ls->block + 1) << CACHE_LINE_SHIFT) - 1);
+    FuncStat *fs = &funcs[f < 0 ? num_functions : f];
+    for (l = 0; l < NR_LEVEL; l ++) {
+      fs->access[l] += ls->access[l];
+      fs->miss[l] += ls->miss[l];
+    }
+  }
+  qsort(funcs, num_functions + 1, sizeof(funcs[0]), cmp_miss);
+
+  Log("cache misses by function:");
+  _Log("  %-20s %14s %7s %14s %7s %12s\n", "function", "L1I access", "miss%",
+      "L1D access", "miss%", "L2 miss");
+  for (i = 0; i < TOP_N && i <= num_functions; i ++) {
+    FuncStat *fs = &funcs[i];
+    if (fs->access[L1I] == 0) break;
+    _Log("  %-20.20s %14" PRIu64 " %7.2f %14" PRIu64 " %7.2f %12" PRIu64 "\n",
+        (fs->func == num_functions ? "???" : functions[fs->func].name),
+        fs->access[L1I], rate(fs->miss[L1I], fs->access[L1I]),
+        fs->access[L1D], rate(fs->miss[L1D], fs->access[L1D]), fs->miss[L2]);
+  }
+  free(funcs);
+}
+
+void cache_dump() {
+  int l;
+
+  flush_batched();
+  Log("cache: %d-byte lines, %s replacement, %s", CONFIG_CACHE_LINE_SIZE,
+      MUXDEF(CONFIG_CACHE_REPL_LRU, "LRU", MUXDEF(CONFIG_CACHE_REPL_FIFO, "FIFO", "random")),
+      MUXDEF(CONFIG_CACHE_WRITE_BACK, "write-back", "write-through"));
+  _Log("  %-5s %8s %5s %16s %16s %7s %14s\n", "level", "size", "ways",
+      "access", "miss", "miss%", "writeback");
+  for (l = 0; l < NR_LEVEL; l ++) {
+    Cache *c = &caches[l];
+    if (!level_enabled(l)) continue;
+    _Log("  %-5s %6uKB %5d %16" PRIu64 " %16" PRIu64 " %7.2f %14" PRIu64 "\n", c->name,
+        (uint32_t)((c->set_mask + 1ull) * c->ways * CONFIG_CACHE_LINE_SIZE / 1024), c->ways,
+        c->access, c->miss, rate(c->miss, c->access), c->writeback);
+  }
+  _Log("  memory reads = %" PRIu64 ", writes = %" PRIu64 "\n", mem_read, mem_write);
+
+  if (by_function) dump_by_function();
+}
@@ -0,0 +1,109 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <isa.h>
+#include <memory/paddr.h>
+#include <memory/snapshot.h>
+#include <memory/checkpoint.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+extern uint64_t g_nr_guest_inst;
+
+static bool is_zero_page(const uint8_t *p) {
+  const uint64_t *w = (const uint64_t *)p;
+  int i;
+  for (i = 0; i < PAGE_SIZE / sizeof(w[0]); i ++) {
+    if (w[i] != 0) return false;
+  }
+  return true;
+}
+
+static void write_all(int fd, const void *buf, size_t n, off_t offset) {
+  ssize_t ret = pwrite(fd, buf, n, offset);
+  Assert(ret == n, "Can not write the checkpoint");
+}
+
+static void read_all(int fd, void *buf, size_t n, off_t offset) {
+  ssize_t ret = pread(fd, buf, n, offset);
+  Assert(ret == n, "Can not read the checkpoint");
+}
+
+void checkpoint_save(const char *file) {
+  int fd = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  Assert(fd >= 0, "Can not open '%s'", file);
+
+  CheckpointHeader h = {
+    .magic = CKPT_MAGIC, .version = CKPT_VERSION, .isa = str(__GUEST_ISA__),
+    .mbase = CONFIG_MBASE, .msize = CONFIG_MSIZE, .nr_inst = g_nr_guest_inst,
+    .cpu_size = sizeof(cpu), .dev_size = snapshot_dev_record_size(),
+  };
+  h.cpu_offset = sizeof(h);
+  h.dev_offset = h.cpu_offset + h.cpu_size;
+  h.mem_offset = ROUNDUP(h.dev_offset + h.dev_size, PAGE_SIZE);
+
+  write_all(fd, &h, sizeof(h), 0);
+  write_all(fd, &cpu, h.cpu_size, h.cpu_offset);
+  uint8_t *dev = malloc(h.dev_size);
+  assert(h.dev_size == 0 || dev);
+  snapshot_dev_save_records(dev);
+  write_all(fd, dev, h.dev_size, h.dev_offset);
+  free(dev);
+
+  uint8_t *mem = guest_to_host(PMEM_LEFT);
+  uint64_t off, nr_page = 0;
+  for (off = 0; off < CONFIG_MSIZE; off += PAGE_SIZE) {
+    if (is_zero_page(mem + off)) continue;
+    write_all(fd, mem + off, PAGE_SIZE, h.mem_offset + off);
+    nr_page ++;
+  }
+  // extend the file to cover the holes at the end
+  int ret = ftruncate(fd, h.mem_offset + CONFIG_MSIZE);
+  Assert(ret == 0, "Can not write the checkpoint");
+  close(fd);
+
+  Log("Checkpoint is saved to %s at instruction %" PRIu64 " with %" PRIu64 " non-zero pages",
+      file, g_nr_guest_inst, nr_page);
+}
+
+long checkpoint_restore(const char *file) {
+  int fd = open(file, O_RDONLY);
+  Assert(fd >= 0, "Can not open '%s'", file);
+
+  CheckpointHeader h;
+  read_all(fd, &h, sizeof(h), 0);
+  Assert(h.magic == CKPT_MAGIC && h.version == CKPT_VERSION,
+      "'%s' is not a checkpoint of this version", file);
+  Assert(strcmp(h.isa, str(__GUEST_ISA__)) == 0, "checkpoint is taken for ISA %s", h.isa);
+  Assert(h.mbase == CONFIG_MBASE && h.msize == CONFIG_MSIZE,
+      "memory [0x%" PRIx64 ", +0x%" PRIx64 "] of the checkpoint does not match", h.mbase, h.msize);
+  Assert(h.cpu_size == sizeof(cpu), "CPU state of the checkpoint does not match");
+
+  read_all(fd, &cpu, h.cpu_size, h.cpu_offset);
+  uint8_t *dev = malloc(h.dev_size);
+  assert(h.dev_size == 0 || dev);
+  read_all(fd, dev, h.dev_size, h.dev_offset);
+  snapshot_dev_load_records(dev, h.dev_size);
+  free(dev);
+
+  pmem_map(fd, h.mem_offset);
+  close(fd);
+  g_nr_guest_inst = h.nr_inst;
+
+  Log("Checkpoint %s is restored at instruction %" PRIu64 ", pc = " FMT_WORD,
+      file, g_nr_guest_inst, cpu.pc);
+  return CONFIG_MSIZE - CONFIG_PC_RESET_OFFSET;
+}
@@ -0,0 +1,180 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <isa.h>
+#include <memory/mtrace.h>
+#include <cpu/cpu.h>
+#ifdef CONFIG_ELF_SYMBOLS
+#include <ftrace.h>
+#endif
+
+/* With `--mtrace=FILE`, the accesses of the guest passing the filter are
+ * buffered and written to FILE as binary records. The filter is set with
+ * `--mtrace-filter=SPEC` or the `mtrace` command of sdb, where SPEC is a
+ * list of
+ *   addr=LO:HI   trace accesses to [LO, HI) only, or addr=all
+ *   pc=LO:HI     trace accesses by the instructions in [LO, HI) only,
+ *                or pc=FUNC for a function of `--elf`, or pc=all
+ *   type=rwx     trace reads, writes and fetches, reads and writes by default
+ * The accesses replayed by reverse execution are not traced again.
+ */
+
+#define NR_BUF 4096
+
+int mtrace_type = 0;
+
+static FILE *mtrace_fp = NULL;
+static bool enabled = false;
+static MTraceRecord buf[NR_BUF];
+static int nr_buf = 0;
+static uint64_t nr_record = 0;
+
+// the ranges are inclusive, so that they can cover the whole space
+typedef struct {
+  int type;
+  word_t addr_lo, addr_hi;
+  word_t pc_lo, pc_hi;
+} Filter;
+
+static Filter filter = { .type = MTRACE_READ | MTRACE_WRITE, .addr_hi = -1, .pc_hi = -1 };
+
+static void flush() {
+  if (nr_buf == 0) return;
+  fwrite(buf, sizeof(buf[0]), nr_buf, mtrace_fp);
+  fflush(mtrace_fp);
+  nr_buf = 0;
+}
+
+void mtrace_record(int type, vaddr_t addr, int len, word_t data) {
+  if (g_replaying) return;
+  if (addr < filter.addr_lo || addr > filter.addr_hi) return;
+  if (cpu.pc < filter.pc_lo || cpu.pc > filter.pc_hi) return;
+  buf[nr_buf ++] = (MTraceRecord){ .pc = cpu.pc, .addr = addr, .data = data,
+    .len_type = len | (type << 4) };
+  nr_record ++;
+  if (nr_buf == NR_BUF) flush();
+}
+
+static void update() {
+  mtrace_type = (enabled ? filter.type : 0);
+}
+
+void mtrace_enable(bool enable) {
+  if (enable && mtrace_fp == NULL) {
+    printf("No trace file, run NEMU with --mtrace=FILE\n");
+    return;
+  }
+  enabled = enable;
+  update();
+  if (mtrace_fp != NULL) flush();
+}
+
+static bool parse_range(char *val, word_t *lo, word_t *hi) {
+  if (strcmp(val, "all") == 0) {
+    *lo = 0;
+    *hi = -1;
+    return true;
+  }
+  char *end;
+  uint64_t l = strtoull(val, &end, 0);
+  if (*end == ':') {
+    uint64_t h = strtoull(end + 1, &end, 0);
+    if (*end == '\0' && h > l) {
+      *lo = l;
+      *hi = h - 1;
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool parse_func(char *val, word_t *lo, word_t *hi) {
+#ifdef CONFIG_ELF_SYMBOLS
+  uint32_t i;
+  for (i = 0; i < num_functions; i ++) {
+    if (strcmp(functions[i].name, val) == 0) {
+      *lo = functions[i].start_addr;
+      *hi = functions[i].start_addr + (functions[i].size == 0 ? 0 : functions[i].size - 1);
+      return true;
+    }
+  }
+#endif
+  return false;
+}
+
+// the filter is changed only if the whole spec is good
+bool mtrace_set_filter(char *spec) {
+  Filter f = filter;
+  char *tok;
+  for (tok = strtok(spec, " ,"); tok != NULL; tok = strtok(NULL, " ,")) {
+    char *val = strchr(tok, '=');
+    bool ok = (val != NULL);
+    if (ok) {
+      *val ++ = '\0';
+      if (strcmp(tok, "addr") == 0) ok = parse_range(val, &f.addr_lo, &f.addr_hi);
+      else if (strcmp(tok, "pc") == 0) ok = parse_range(val, &f.pc_lo, &f.pc_hi) ||
+        parse_func(val, &f.pc_lo, &f.pc_hi);
+      else if (strcmp(tok, "type") == 0) {
+        int type = 0;
+        char *p;
+        for (p = val; *p != '\0' && ok; p ++) {
+          switch (*p) {
+            case 'r': type |= MTRACE_READ; break;
+            case 'w': type |= MTRACE_WRITE; break;
+            case 'x': type |= MTRACE_FETCH; break;
+            default: ok = false;
+          }
+        }
+        if (ok) f.type = type;
+      }
+      else ok = false;
+    }
+    if (!ok) {
+      printf("Bad mtrace filter '%s%s%s'\n", tok, (val == NULL ? "" : "="), (val == NULL ? "" : val));
+      return false;
+    }
+  }
+  filter = f;
+  update();
+  return true;
+}
+
+void mtrace_info() {
+  printf("mtrace is %s, %" PRIu64 " records are written\n", (enabled ? "on" : "off"), nr_record);
+  printf("type=%s%s%s addr=" FMT_WORD ":" FMT_WORD " pc=" FMT_WORD ":" FMT_WORD " (inclusive)\n",
+      (filter.type & MTRACE_READ ? "r" : ""), (filter.type & MTRACE_WRITE ? "w" : ""),
+      (filter.type & MTRACE_FETCH ? "x" : ""),
+      filter.addr_lo, filter.addr_hi, filter.pc_lo, filter.pc_hi);
+}
+
+static void close_mtrace() {
+  flush();
+  fclose(mtrace_fp);
+}
+
+void init_mtrace(const char *file, char *spec) {
+  if (spec != NULL) Assert(mtrace_set_filter(spec), "Bad --mtrace-filter");
+  if (file == NULL) return;
+
+  mtrace_fp = fopen(file, "wb");
+  Assert(mtrace_fp, "Can not open '%s'", file);
+  uint8_t word_size = sizeof(word_t);
+  fwrite(MTRACE_MAGIC, sizeof(MTRACE_MAGIC) - 1, 1, mtrace_fp);
+  fwrite(&word_size, 1, 1, mtrace_fp);
+  atexit(close_mtrace);
+  mtrace_enable(true);
+  Log("Trace the memory accesses to %s", file);
+}
@@ -15,8 +15,14 @@
 
 #include <memory/host.h>
 #include <memory/paddr.h>
+#include <memory/snapshot.h>
+#include <cpu/watchpoint.h>
+#include <cpu/difftest.h>
 #include <device/mmio.h>
 #include <isa.h>
+#ifdef CONFIG_CHECKPOINT
+#include <sys/mman.h>
+#endif
 
 #if   defined(CONFIG_PMEM_MALLOC)
 static uint8_t *pmem = NULL;
@@ -56,10 +62,24 @@ void init_mem() {
   Log("physical memory area [" FMT_PADDR ", " FMT_PADDR "]", PMEM_LEFT, PMEM_RIGHT);
 }
 
+#ifdef CONFIG_CHECKPOINT
+void pmem_map(int fd, long offset) {
+#if   defined(CONFIG_PMEM_MALLOC)
+  free(pmem);
+  pmem = mmap(NULL, CONFIG_MSIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, offset);
+#else
+  void *ret = mmap(pmem, CONFIG_MSIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, offset);
+  Assert(ret == pmem, "Can not map the memory image");
+#endif
+  Assert(pmem != MAP_FAILED, "Can not map the memory image");
+}
+#endif
+
 word_t paddr_read(paddr_t addr, int len) {
   if (likely(in_pmem(addr))) {
+    PERF_BEGIN(PERF_PADDR);
     word_t res = pmem_read(addr, len);
-    IFDEF(CONFIG_MTRACE, Log("address = " FMT_PADDR " read " FMT_PADDR " at pc = " FMT_WORD, addr, res, cpu.pc));
+    PERF_END();
     return res;
   }
   IFDEF(CONFIG_DEVICE, return mmio_read(addr, len));
@@ -69,8 +89,12 @@ word_t paddr_read(paddr_t addr, int len) {
 
 void paddr_write(paddr_t addr, int len, word_t data) {
   if (likely(in_pmem(addr))) {
+    PERF_BEGIN(PERF_PADDR);
+    IFDEF(CONFIG_SNAPSHOT, snapshot_track_write(addr, len));
+    IFDEF(CONFIG_WATCHPOINT, wp_track_write(addr, len));
+    IFDEF(CONFIG_DIFFTEST_BATCH, difftest_track_write(addr, len));
     pmem_write(addr, len, data);
-    IFDEF(CONFIG_MTRACE, Log("address = " FMT_PADDR " write " FMT_PADDR " at pc = " FMT_WORD, addr, data, cpu.pc));
+    PERF_END();
     return ;
   }
   IFDEF(CONFIG_DEVICE, mmio_write(addr, len, data); return);
@@ -0,0 +1,302 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <isa.h>
+#include <memory/paddr.h>
+#include <memory/snapshot.h>
+#include <cpu/difftest.h>
+
+typedef struct {
+  uint32_t pg;
+  uint8_t data[PAGE_SIZE];
+} PageCopy;
+
+typedef struct {
+  uint32_t epoch;
+  uint64_t nr_inst;
+  CPU_state cpu;
+  // contents of the pages before they are written for the first time
+  // after this snapshot is taken
+  PageCopy **page;
+  int nr_page;
+  int max_page;
+  uint8_t *dev; // states registered by devices
+  bool user; // taken by the user, never dropped to make room
+} Snapshot;
+
+static Snapshot snapshot[NR_SNAPSHOT] = {};
+static int nr_snapshot = 0;
+static uint32_t epoch_count = 0;
+
+#define NR_DEV_STATE 32
+#define NR_DEV_CALLBACK 8
+
+static struct {
+  const char *name;
+  void *state;
+  size_t size;
+  bool in_ckpt;
+} dev_state[NR_DEV_STATE] = {};
+static int nr_dev_state = 0;
+static size_t dev_state_size = 0;
+
+static struct {
+  snapshot_callback_t save, restore;
+} dev_callback[NR_DEV_CALLBACK] = {};
+static int nr_dev_callback = 0;
+
+static void add_state(const char *name, void *state, size_t size, bool in_ckpt) {
+  Assert(nr_dev_state < NR_DEV_STATE, "Too many device states, increase NR_DEV_STATE");
+  assert(nr_snapshot == 0);
+  Assert(strlen(name) < sizeof(((DevRecord *)0)->name), "The name of device state '%s' is too long", name);
+  int i;
+  for (i = 0; i < nr_dev_state; i ++) {
+    Assert(strcmp(dev_state[i].name, name) != 0, "Device state '%s' is added twice", name);
+  }
+  dev_state[nr_dev_state].name = name;
+  dev_state[nr_dev_state].state = state;
+  dev_state[nr_dev_state].size = size;
+  dev_state[nr_dev_state].in_ckpt = in_ckpt;
+  nr_dev_state ++;
+  dev_state_size += size;
+}
+
+void snapshot_add_state(const char *name, void *state, size_t size) {
+  add_state(name, state, size, true);
+}
+
+void snapshot_add_tool_state(const char *name, void *state, size_t size) {
+  add_state(name, state, size, false);
+}
+
+void snapshot_add_callback(snapshot_callback_t save, snapshot_callback_t restore) {
+  Assert(nr_dev_callback < NR_DEV_CALLBACK, "Too many device callbacks, increase NR_DEV_CALLBACK");
+  assert(nr_snapshot == 0);
+  dev_callback[nr_dev_callback].save = save;
+  dev_callback[nr_dev_callback].restore = restore;
+  nr_dev_callback ++;
+}
+
+size_t snapshot_dev_size() {
+  return dev_state_size;
+}
+
+void snapshot_dev_save(uint8_t *buf) {
+  int i;
+  for (i = 0; i < nr_dev_callback; i ++) {
+    if (dev_callback[i].save != NULL) dev_callback[i].save();
+  }
+  for (i = 0; i < nr_dev_state; i ++) {
+    memcpy(buf, dev_state[i].state, dev_state[i].size);
+    buf += dev_state[i].size;
+  }
+}
+
+void snapshot_dev_load(const uint8_t *buf) {
+  const uint8_t *p = buf;
+  int i;
+  for (i = 0; i < nr_dev_state; i ++) {
+    memcpy(dev_state[i].state, p, dev_state[i].size);
+    p += dev_state[i].size;
+  }
+  for (i = 0; i < nr_dev_callback; i ++) {
+    if (dev_callback[i].restore != NULL) dev_callback[i].restore();
+  }
+}
+
+size_t snapshot_dev_record_size() {
+  size_t size = 0;
+  int i;
+  for (i = 0; i < nr_dev_state; i ++) {
+    if (dev_state[i].in_ckpt) size += sizeof(DevRecord) + dev_state[i].size;
+  }
+  return size;
+}
+
+void snapshot_dev_save_records(uint8_t *buf) {
+  int i;
+  for (i = 0; i < nr_dev_callback; i ++) {
+    if (dev_callback[i].save != NULL) dev_callback[i].save();
+  }
+  for (i = 0; i < nr_dev_state; i ++) {
+    if (!dev_state[i].in_ckpt) continue;
+    DevRecord r = { .size = dev_state[i].size };
+    strcpy(r.name, dev_state[i].name);
+    memcpy(buf, &r, sizeof(r));
+    memcpy(buf + sizeof(r), dev_state[i].state, r.size);
+    buf += sizeof(r) + r.size;
+  }
+}
+
+void snapshot_dev_load_records(const uint8_t *buf, size_t size) {
+  const uint8_t *end = buf + size;
+  int i;
+  while (buf < end) {
+    DevRecord r;
+    Assert(end - buf >= sizeof(r), "The device states are truncated");
+    memcpy(&r, buf, sizeof(r));
+    buf += sizeof(r);
+    Assert(end - buf >= r.size && r.name[sizeof(r.name) - 1] == '\0', "The device states are corrupted");
+
+    for (i = 0; i < nr_dev_state; i ++) {
+      if (dev_state[i].in_ckpt && strcmp(dev_state[i].name, r.name) == 0) break;
+    }
+    if (i == nr_dev_state) {
+      Log("Skip the state of device '%s' which is not in this build", r.name);
+    } else {
+      Assert(r.size == dev_state[i].size, "The state of device '%s' has %" PRIu64
+          " bytes, but %zu bytes are expected", r.name, r.size, dev_state[i].size);
+      memcpy(dev_state[i].state, buf, r.size);
+    }
+    buf += r.size;
+  }
+  for (i = 0; i < nr_dev_callback; i ++) {
+    if (dev_callback[i].restore != NULL) dev_callback[i].restore();
+  }
+}
+
+// 0 means no snapshot is taken, and no page will be saved
+uint32_t snapshot_epoch = 0;
+uint32_t snapshot_page_epoch[SNAPSHOT_NR_PAGE] = {};
+
+extern uint64_t g_nr_guest_inst;
+
+static void add_page(Snapshot *s, PageCopy *p) {
+  if (s->nr_page == s->max_page) {
+    s->max_page = (s->max_page == 0 ? 64 : s->max_page * 2);
+    s->page = realloc(s->page, sizeof(s->page[0]) * s->max_page);
+    assert(s->page);
+  }
+  s->page[s->nr_page ++] = p;
+}
+
+void snapshot_save_page(uint32_t pg) {
+  snapshot_page_epoch[pg] = snapshot_epoch;
+
+  PageCopy *p = malloc(sizeof(PageCopy));
+  assert(p);
+  p->pg = pg;
+  memcpy(p->data, guest_to_host(PMEM_LEFT + ((paddr_t)pg << PAGE_SHIFT)), PAGE_SIZE);
+  add_page(&snapshot[nr_snapshot - 1], p);
+}
+
+static void free_pages(Snapshot *s) {
+  int i;
+  for (i = 0; i < s->nr_page; i ++) {
+    free(s->page[i]);
+  }
+  s->nr_page = 0;
+}
+
+static void undo_pages(Snapshot *s) {
+  int i;
+  for (i = 0; i < s->nr_page; i ++) {
+    PageCopy *p = s->page[i];
+    memcpy(guest_to_host(PMEM_LEFT + ((paddr_t)p->pg << PAGE_SHIFT)), p->data, PAGE_SIZE);
+    free(p);
+  }
+  s->nr_page = 0;
+}
+
+static void new_epoch(Snapshot *s) {
+  // every page has an older epoch, so it will be saved on its next write
+  s->epoch = ++ epoch_count;
+  snapshot_epoch = s->epoch;
+}
+
+/* Drop snapshot `idx`. The pages of the oldest snapshot are only needed to
+ * go back to it. The pages of a later one still hold the contents at the
+ * previous snapshot if the previous one has no copies of them, so they are
+ * handed over.
+ */
+static void drop(int idx) {
+  Snapshot *s = &snapshot[idx];
+  if (idx == 0) free_pages(s);
+  else {
+    Snapshot *prev = &snapshot[idx - 1];
+    bool *saved = calloc(SNAPSHOT_NR_PAGE, sizeof(bool));
+    assert(saved);
+    int i;
+    for (i = 0; i < prev->nr_page; i ++) saved[prev->page[i]->pg] = true;
+    for (i = 0; i < s->nr_page; i ++) {
+      if (saved[s->page[i]->pg]) free(s->page[i]);
+      else add_page(prev, s->page[i]);
+    }
+    s->nr_page = 0;
+    free(saved);
+  }
+  free(s->page);
+  free(s->dev);
+  memmove(s, s + 1, sizeof(snapshot[0]) * (nr_snapshot - idx - 1));
+  nr_snapshot --;
+}
+
+int snapshot_take(bool user) {
+  int i, nr_user = 0;
+  for (i = 0; i < nr_snapshot; i ++) nr_user += snapshot[i].user;
+  if (user && nr_user == NR_USER_SNAPSHOT) return -1;
+
+  if (nr_snapshot == NR_SNAPSHOT) {
+    // drop the oldest one which is not taken by the user
+    for (i = 0; snapshot[i].user; i ++);
+    drop(i);
+  }
+
+  Snapshot *s = &snapshot[nr_snapshot ++];
+  s->user = user;
+  s->nr_inst = g_nr_guest_inst;
+  s->cpu = cpu;
+  s->dev = malloc(dev_state_size);
+  assert(dev_state_size == 0 || s->dev);
+  snapshot_dev_save(s->dev);
+  s->page = NULL;
+  s->nr_page = s->max_page = 0;
+  new_epoch(s);
+  return nr_snapshot - 1;
+}
+
+void snapshot_restore(int idx) {
+  assert(idx >= 0 && idx < nr_snapshot);
+
+  // undo from the latest snapshot, so that the oldest contents win
+  int i;
+  for (i = nr_snapshot - 1; i >= idx; i --) {
+    undo_pages(&snapshot[i]);
+    if (i > idx) {
+      free(snapshot[i].page);
+      free(snapshot[i].dev);
+    }
+  }
+  nr_snapshot = idx + 1;
+
+  Snapshot *s = &snapshot[idx];
+  cpu = s->cpu;
+  g_nr_guest_inst = s->nr_inst;
+  snapshot_dev_load(s->dev);
+  new_epoch(s);
+
+  // the reference design is not restored along with NEMU
+  difftest_sync();
+}
+
+int snapshot_count() {
+  return nr_snapshot;
+}
+
+uint64_t snapshot_nr_inst(int idx) {
+  assert(idx >= 0 && idx < nr_snapshot);
+  return snapshot[idx].nr_inst;
+}
@@ -14,10 +14,16 @@
 ***************************************************************************************/
 
 #include <isa.h>
+#include <cpu/cpu.h>
 #include <memory/paddr.h>
+#include <memory/cache.h>
+#include <memory/mtrace.h>
 
 word_t vaddr_ifetch(vaddr_t addr, int len) {
-  return paddr_read(addr, len);
+  IFDEF(CONFIG_CACHE_SIM, if (likely(!g_replaying)) cache_ifetch(addr));
+  word_t inst = paddr_read(addr, len);
+  IFDEF(CONFIG_MTRACE, mtrace_access(MTRACE_FETCH, addr, len, inst));
+  return inst;
 }
 
 word_t vaddr_read(vaddr_t addr, int len) {
@@ -0,0 +1,165 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <isa.h>
+#include <cpu/decode.h>
+#include <memory/host.h>
+#include <memory/paddr.h>
+#ifdef CONFIG_DEVICE
+#include <device/map.h>
+#endif
+#include <time.h>
+
+/* Microbenchmarks of the primitives on the hot path of the interpreter.
+ * Every primitive is called in a tight loop with synthetic inputs, and
+ * the fastest of ROUNDS runs is reported in ns per call. This is linked
+ * with the objects of NEMU in place of nemu-main.c, and accepts the same
+ * arguments; the image is loaded but not run.
+ */
+
+void init_monitor(int, char *[]);
+
+#ifndef MICROBENCH_ITER
+#define MICROBENCH_ITER (1 << 22)
+#endif
+#define ROUNDS 3
+
+#define CODE_BASE RESET_VECTOR
+#define CODE_LEN  1024 // instructions
+#define DATA_BASE (RESET_VECTOR + 0x100000)
+#define DATA_MASK 0xfff8 // 8-byte aligned offsets in a 64KB area
+
+static volatile word_t sink;
+
+static uint64_t now_ns() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1000000000ull + t.tv_nsec;
+}
+
+/* `body` is expanded in the loop, so that the cost of a call is not
+ * measured. The values read are summed up in `acc` to keep the reads.
+ */
+#define BENCH(name, body) do { \
+    uint64_t best = -1; \
+    int r; \
+    for (r = 0; r < ROUNDS; r ++) { \
+      uint64_t i, t0 = now_ns(); \
+      word_t acc = 0; \
+      for (i = 0; i < MICROBENCH_ITER; i ++) { body; } \
+      uint64_t t = now_ns() - t0; \
+      sink = acc; \
+      if (t < best) best = t; \
+    } \
+    _Log("  %-24s %10.2f ns/op\n", name, (double)best / MICROBENCH_ITER); \
+  } while (0)
+
+#if defined(CONFIG_ISA_riscv32) || defined(CONFIG_ISA_riscv64)
+// a0 = x10, a1 = x11, a2 = x12, s1 = x9; all of them fall through to the next instruction
+static const struct {
+  const char *name;
+  uint32_t inst[4];
+} insts[] = {
+  { "addi a0, a0, 1",       { 0x00150513 } },
+  { "add a0, a0, a1",       { 0x00b50533 } },
+  { "lui a0, 0x12345",      { 0x12345537 } },
+  { "mul a0, a0, a1",       { 0x02b50533 } },
+  { "div a0, a1, a2",       { 0x02c5c533 } },
+  { "lw a0, 0(s1)",         { 0x0004a503 } },
+  { "sw a0, 0(s1)",         { 0x00a4a023 } },
+  { "beq x0, x0, +4",       { 0x00000263 } },
+  { "bne x0, x0, +8",       { 0x00001463 } },
+  { "jal x0, +4",           { 0x0040006f } },
+  { "mix of the above",     { 0x00150513, 0x0004a503, 0x00a4a023, 0x00000263 } },
+};
+
+static void bench_decode() {
+  int k, j;
+  _Log("decode_exec, with the instruction fetch:\n");
+  for (k = 0; k < ARRLEN(insts); k ++) {
+    int n = 1;
+    while (n < ARRLEN(insts[k].inst) && insts[k].inst[n] != 0) n ++;
+    uint32_t *code = (uint32_t *)guest_to_host(CODE_BASE);
+    for (j = 0; j < CODE_LEN; j ++) code[j] = insts[k].inst[j % n];
+
+    cpu.gpr[9] = DATA_BASE;
+    cpu.gpr[11] = 3;
+    cpu.gpr[12] = 7;
+    Decode s;
+    vaddr_t pc = CODE_BASE;
+    BENCH(insts[k].name,
+      s.pc = pc; s.snpc = pc;
+      isa_exec_once(&s);
+      pc = (s.dnpc == CODE_BASE + CODE_LEN * 4 ? CODE_BASE : s.dnpc));
+    Assert(nemu_state.state != NEMU_ABORT, "%s is not executed", insts[k].name);
+  }
+}
+#else
+static void bench_decode() {
+  _Log("decode_exec: no synthetic instructions for " str(__GUEST_ISA__) "\n");
+}
+#endif
+
+static void bench_paddr() {
+  _Log("paddr_read/paddr_write, in pmem:\n");
+  BENCH("paddr_read(1)",  acc += paddr_read(DATA_BASE + (i * 8 & DATA_MASK), 1));
+  BENCH("paddr_read(4)",  acc += paddr_read(DATA_BASE + (i * 8 & DATA_MASK), 4));
+  BENCH("paddr_write(1)", paddr_write(DATA_BASE + (i * 8 & DATA_MASK), 1, i));
+  BENCH("paddr_write(4)", paddr_write(DATA_BASE + (i * 8 & DATA_MASK), 4, i));
+}
+
+#ifdef CONFIG_DEVICE
+static uint8_t map_space[DATA_MASK + 8];
+
+static void nop_callback(uint32_t offset, int len, bool is_write) {
+}
+
+static void bench_map() {
+  // registered maps are kept by map.c, so this must outlive the function
+  static IOMap map = { .name = "microbench", .low = 0, .high = sizeof(map_space) - 1, .space = map_space };
+  map_register(&map);
+  _Log("map_read/map_write:\n");
+  BENCH("map_read(4)",            acc += map_read(i * 8 & DATA_MASK, 4, &map));
+  BENCH("map_write(4)",           map_write(i * 8 & DATA_MASK, 4, i, &map));
+  map.callback = nop_callback;
+  BENCH("map_read(4), callback",  acc += map_read(i * 8 & DATA_MASK, 4, &map));
+  BENCH("map_write(4), callback", map_write(i * 8 & DATA_MASK, 4, i, &map));
+}
+#endif
+
+static void bench_host() {
+  uint8_t *p = guest_to_host(DATA_BASE);
+  _Log("host_read/host_write:\n");
+  BENCH("host_read(1)",  acc += host_read(p + (i * 8 & DATA_MASK), 1));
+  BENCH("host_read(4)",  acc += host_read(p + (i * 8 & DATA_MASK), 4));
+  BENCH("host_write(1)", host_write(p + (i * 8 & DATA_MASK), 1, i));
+  BENCH("host_write(4)", host_write(p + (i * 8 & DATA_MASK), 4, i));
+}
+
+int main(int argc, char *argv[]) {
+  init_monitor(argc, argv);
+#ifdef CONFIG_TRACE
+  // the tracers run inside the primitives and would dominate the numbers
+  panic("The tracers are enabled, build with riscv32-fast_defconfig for microbenchmarks");
+#endif
+
+  Log("microbenchmarks, %d calls per run, the fastest of %d runs", MICROBENCH_ITER, ROUNDS);
+  bench_decode();
+  bench_paddr();
+  IFDEF(CONFIG_DEVICE, bench_map());
+  bench_host();
+  return 0;
+}
@@ -1,6 +1,18 @@
 #include "ftrace.h"
 #include <debug.h>
 
+#ifdef CONFIG_ELF_SYMBOLS
+// Return the index of the function containing addr, or -1 if not found
+int find_function(Elf32_Addr addr) {
+    for (uint32_t i = 0; i < num_functions; i++) {
+        if (functions[i].start_addr <= addr && addr < functions[i].start_addr + functions[i].size) {
+            return i;
+        }
+    }
+    return -1;
+}
+#endif
+
 // Function to parse the ELF file and retrieve the symbol table
 void load_elf(const char* elf_file, FunctionInfo* functions, uint32_t* num_functions) {
     uint32_t function_num = *num_functions;
@@ -33,7 +45,7 @@ void load_elf(const char* elf_file, FunctionInfo* functions, uint32_t* num_funct
     ret = fread(shstrtab, section_header[elf_header.e_shstrndx].sh_size, 1, fp);
     
     uint8_t* section_symtab = NULL;
-    uint8_t  numbers_sym_entry = 0;
+    uint32_t numbers_sym_entry = 0;
     char* section_strtab = NULL;
 
     for (int i = 0; i < elf_header.e_shnum; i++) {
@@ -58,6 +70,10 @@ void load_elf(const char* elf_file, FunctionInfo* functions, uint32_t* num_funct
     Elf32_Sym* symtab_entries = (Elf32_Sym*)section_symtab;
     for (int i = 0; i < numbers_sym_entry; i++) {
         if ((symtab_entries[i].st_info & 0xF) == STT_FUNC) {
+            if (function_num == MAX_FUNCTIONS) {
+                Log("Too many functions in %s, only the first %d are loaded", elf_file, MAX_FUNCTIONS);
+                break;
+            }
             strcpy(functions[function_num].name, &section_strtab[symtab_entries[i].st_name]);
             functions[function_num].size = symtab_entries[i].st_size;
             functions[function_num].start_addr = symtab_entries[i].st_value;
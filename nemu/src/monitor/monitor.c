@@ -15,6 +15,7 @@
 
 #include <isa.h>
 #include <memory/paddr.h>
+#include <memory/checkpoint.h>
 #include <ftrace.h>
 
 void init_rand();
@@ -24,6 +25,16 @@ void init_difftest(char *ref_so_file, long img_size, int port);
 void init_device();
 void init_sdb();
 void init_disasm(const char *triple);
+void init_simpoint(const char *bbv_file, char *ckpt_list, const char *prefix);
+void init_reverse();
+void init_replay(const char *record_file, const char *replay_file);
+void init_inst_stat(const char *file);
+void init_profile(const char *file);
+void init_cache();
+void init_bpred();
+void init_mtrace(const char *file, char *spec);
+void init_dtrace(const char *file);
+void init_perf();
 
 static void welcome() {
   Log("Trace: %s", MUXDEF(CONFIG_TRACE, ANSI_FMT("ON", ANSI_FG_GREEN), ANSI_FMT("OFF", ANSI_FG_RED)));
@@ -41,16 +52,31 @@ static void welcome() {
 #include <getopt.h>
 
 void sdb_set_batch_mode();
+void sdb_set_gdb_mode(const char *addr);
+void sdb_set_script(const char *file, const char *out_file);
 
 static char *log_file = NULL;
 static char *diff_so_file = NULL;
 static char *img_file = NULL;
+static char *ckpt_file = NULL;
+static char *bbv_file = NULL;
+static char *ckpt_list = NULL;
+static char *ckpt_prefix = NULL;
+static char *record_file = NULL;
+static char *replay_file = NULL;
+static char *script_file = NULL;
+static char *script_out = NULL;
+static char *inst_stat_file = NULL;
+static char *profile_file = NULL;
+static char *mtrace_file = NULL;
+static char *mtrace_filter = NULL;
+static char *dtrace_file = NULL;
 static int difftest_port = 1234;
 
 static char *elf_file = NULL;
 
-#ifdef CONFIG_FTRACE
-FunctionInfo functions[128];
+#ifdef CONFIG_ELF_SYMBOLS
+FunctionInfo functions[MAX_FUNCTIONS];
 uint32_t num_functions = 0;
 #endif
 
@@ -76,6 +102,14 @@ static long load_img() {
   return size;
 }
 
+// an option of a feature which is not compiled in is an error, not a no-op
+static void option_needs(bool enabled, const char *opt, const char *config) {
+  if (enabled) return;
+  printf("%s needs %s, enable it in menuconfig\n", opt, config);
+  exit(1);
+}
+#define OPTION_NEEDS(config, opt) option_needs(ISDEF(config), opt, #config)
+
 static int parse_args(int argc, char *argv[]) {
   const struct option table[] = {
     {"elf"      , required_argument, NULL, 'e'},
@@ -83,17 +117,45 @@ static int parse_args(int argc, char *argv[]) {
     {"log"      , required_argument, NULL, 'l'},
     {"diff"     , required_argument, NULL, 'd'},
     {"port"     , required_argument, NULL, 'p'},
+    {"restore"  , required_argument, NULL, 'r'},
+    {"bbv"      , required_argument, NULL, 'B'},
+    {"ckpt-at"  , required_argument, NULL, 'C'},
+    {"ckpt-prefix", required_argument, NULL, 'P'},
+    {"gdb"      , required_argument, NULL, 'g'},
+    {"record"   , required_argument, NULL, 'R'},
+    {"replay"   , required_argument, NULL, 'Y'},
+    {"script"   , required_argument, NULL, 's'},
+    {"script-out", required_argument, NULL, 'O'},
+    {"inst-stat", required_argument, NULL, 'I'},
+    {"profile"  , required_argument, NULL, 'F'},
+    {"mtrace"   , required_argument, NULL, 'M'},
+    {"mtrace-filter", required_argument, NULL, 'm'},
+    {"dtrace"   , required_argument, NULL, 'D'},
     {"help"     , no_argument      , NULL, 'h'},
     {0          , 0                , NULL,  0 },
   };
   int o;
-  while ( (o = getopt_long(argc, argv, "-bhl:d:p:e:", table, NULL)) != -1) {
+  while ( (o = getopt_long(argc, argv, "-bhl:d:p:e:r:s:", table, NULL)) != -1) {
     switch (o) {
       case 'e': elf_file = optarg; break;
       case 'b': sdb_set_batch_mode(); break;
       case 'p': sscanf(optarg, "%d", &difftest_port); break;
       case 'l': log_file = optarg; break;
       case 'd': diff_so_file = optarg; break;
+      case 'r': OPTION_NEEDS(CONFIG_CHECKPOINT, "--restore"); ckpt_file = optarg; break;
+      case 'B': OPTION_NEEDS(CONFIG_SIMPOINT, "--bbv"); bbv_file = optarg; break;
+      case 'C': OPTION_NEEDS(CONFIG_SIMPOINT, "--ckpt-at"); OPTION_NEEDS(CONFIG_CHECKPOINT, "--ckpt-at"); ckpt_list = optarg; break;
+      case 'P': OPTION_NEEDS(CONFIG_SIMPOINT, "--ckpt-prefix"); OPTION_NEEDS(CONFIG_CHECKPOINT, "--ckpt-prefix"); ckpt_prefix = optarg; break;
+      case 'g': OPTION_NEEDS(CONFIG_GDBSTUB, "--gdb"); IFDEF(CONFIG_GDBSTUB, sdb_set_gdb_mode(optarg)); break;
+      case 'R': OPTION_NEEDS(CONFIG_REPLAY, "--record"); record_file = optarg; break;
+      case 'Y': OPTION_NEEDS(CONFIG_REPLAY, "--replay"); replay_file = optarg; break;
+      case 's': script_file = optarg; break;
+      case 'O': script_out = optarg; break;
+      case 'I': OPTION_NEEDS(CONFIG_INST_STAT, "--inst-stat"); inst_stat_file = optarg; break;
+      case 'F': OPTION_NEEDS(CONFIG_PROFILE, "--profile"); profile_file = optarg; break;
+      case 'M': OPTION_NEEDS(CONFIG_MTRACE, "--mtrace"); mtrace_file = optarg; break;
+      case 'm': OPTION_NEEDS(CONFIG_MTRACE, "--mtrace-filter"); mtrace_filter = optarg; break;
+      case 'D': OPTION_NEEDS(CONFIG_DTRACE, "--dtrace"); dtrace_file = optarg; break;
       case 1: img_file = optarg; return 0;
       default:
         printf("Usage: %s [OPTION...] IMAGE [args]\n\n", argv[0]);
@@ -102,6 +164,20 @@ static int parse_args(int argc, char *argv[]) {
         printf("\t-l,--log=FILE           output log to FILE\n");
         printf("\t-d,--diff=REF_SO        run DiffTest with reference REF_SO\n");
         printf("\t-p,--port=PORT          run DiffTest with port PORT\n");
+        printf("\t-r,--restore=FILE       restore the checkpoint FILE instead of loading IMAGE\n");
+        printf("\t--bbv=FILE              write SimPoint basic block vectors to FILE\n");
+        printf("\t--ckpt-at=N1,N2,...     take checkpoints after N1, N2, ... instructions\n");
+        printf("\t--ckpt-prefix=PATH      name the checkpoints as PATH-N.ckpt\n");
+        printf("\t--gdb=PORT|PATH         wait for GDB on the TCP port or the Unix socket\n");
+        printf("\t--record=FILE           record the inputs from the host to FILE\n");
+        printf("\t--replay=FILE           replay the inputs recorded in FILE\n");
+        printf("\t-s,--script=FILE        run sdb commands in FILE, output results as JSON lines\n");
+        printf("\t--script-out=FILE       write the results of the script to FILE instead of stdout\n");
+        printf("\t--inst-stat=FILE        write the instruction statistics to FILE as CSV\n");
+        printf("\t--profile=FILE          write the sampled call stacks to FILE in folded format\n");
+        printf("\t--mtrace=FILE           write the memory accesses to FILE\n");
+        printf("\t--mtrace-filter=SPEC    trace the accesses matching SPEC only, see `help mtrace`\n");
+        printf("\t--dtrace=FILE           write the device accesses to FILE\n");
         printf("\n");
         exit(0);
     }
@@ -115,12 +191,21 @@ void init_monitor(int argc, char *argv[]) {
   /* Parse arguments. */
   parse_args(argc, argv);
 
-  /* Set random seed. */
-  init_rand();
+  /* Set up the script mode before anything is printed. */
+  if (script_file != NULL) sdb_set_script(script_file, script_out);
+
+  /* Start the host performance counters. */
+  IFDEF(CONFIG_HOST_PERF, init_perf());
 
   /* Open the log file. */
   init_log(log_file);
 
+  /* Open the files to record or replay the inputs. */
+  IFDEF(CONFIG_REPLAY, init_replay(record_file, replay_file));
+
+  /* Set random seed. */
+  init_rand();
+
   /* Initialize memory. */
   init_mem();
 
@@ -130,15 +215,46 @@ void init_monitor(int argc, char *argv[]) {
   /* Perform ISA dependent initialization. */
   init_isa();
 
+  /* Write the sampled call stacks at exit. Snapshots keep the call stack, so do it before any. */
+  IFDEF(CONFIG_PROFILE, init_profile(profile_file));
+
   /* Load the elf of image. This will help us to get function trace. */
-  IFDEF(CONFIG_FTRACE, load_elf(elf_file, functions, &num_functions));
+#ifdef CONFIG_ELF_SYMBOLS
+  if (elf_file != NULL) load_elf(elf_file, functions, &num_functions);
+#endif
   
   /* Load the image to memory. This will overwrite the built-in image. */
-  long img_size = load_img();
+  long img_size;
+#ifdef CONFIG_CHECKPOINT
+  if (ckpt_file != NULL) img_size = checkpoint_restore(ckpt_file);
+  else
+#endif
+  img_size = load_img();
 
   /* Initialize differential testing. */
   init_difftest(diff_so_file, img_size, difftest_port);
 
+  /* Initialize SimPoint profiling. */
+  IFDEF(CONFIG_SIMPOINT, init_simpoint(bbv_file, ckpt_list, ckpt_prefix));
+
+  /* Write the instruction statistics as CSV at exit. */
+  IFDEF(CONFIG_INST_STAT, init_inst_stat(inst_stat_file));
+
+  /* Initialize the cache simulator. */
+  IFDEF(CONFIG_CACHE_SIM, init_cache());
+
+  /* Initialize the branch predictors. */
+  IFDEF(CONFIG_BPRED, init_bpred());
+
+  /* Open the file of the memory trace. */
+  IFDEF(CONFIG_MTRACE, init_mtrace(mtrace_file, mtrace_filter));
+
+  /* Open the file of the device trace. */
+  IFDEF(CONFIG_DTRACE, init_dtrace(dtrace_file));
+
+  /* Take the first snapshot for reverse execution. */
+  IFDEF(CONFIG_REVERSE, init_reverse());
+
   /* Initialize the simple debugger. */
   init_sdb();
 
@@ -0,0 +1,109 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include "sdb.h"
+#include <cpu/cpu.h>
+#include <cpu/breakpoint.h>
+
+#define NR_BP 32
+
+typedef struct {
+  bool in_use;
+  vaddr_t pc;
+  uint64_t hits;
+  char cond[64];    // empty if unconditional
+  ExprOp code[NR_EXPR_OP];
+  int nr_code;
+} BP;
+
+static BP bp_pool[NR_BP] = {};
+
+uint8_t bp_filter[BP_FILTER_SIZE] = {};
+vaddr_t bp_skip_pc = -1;
+int bp_last_hit = -1; // NO of the latest hit breakpoint
+
+/* Set up a breakpoint at `pc`. `cond` is an expression (or NULL) which is
+ * evaluated each time the breakpoint is reached. Return the NO of the new
+ * breakpoint, or -1 if there is no free one or `cond` is invalid.
+ */
+int new_bp(vaddr_t pc, char *cond) {
+  int i;
+  for (i = 0; i < NR_BP; i ++) {
+    if (!bp_pool[i].in_use) break;
+  }
+  if (i == NR_BP) return -1;
+
+  BP *bp = &bp_pool[i];
+  bp->nr_code = 0;
+  bp->cond[0] = '\0';
+  if (cond != NULL) {
+    bp->nr_code = expr_compile(cond, bp->code, NULL);
+    if (bp->nr_code < 0) return -1;
+    strncpy(bp->cond, cond, sizeof(bp->cond) - 1);
+  }
+  bp->in_use = true;
+  bp->pc = pc;
+  bp->hits = 0;
+  bp_filter[bp_hash(pc)] ++;
+  return i;
+}
+
+bool free_bp(int n) {
+  if (n < 0 || n >= NR_BP || !bp_pool[n].in_use) return false;
+  bp_pool[n].in_use = false;
+  bp_filter[bp_hash(bp_pool[n].pc)] --;
+  return true;
+}
+
+bool bp_check(vaddr_t pc) {
+  if (g_debug_mode == DEBUG_OFF) return false;
+  if (pc == bp_skip_pc) {
+    bp_skip_pc = -1;
+    return false;
+  }
+
+  bool stop = false;
+  int i;
+  for (i = 0; i < NR_BP; i ++) {
+    BP *bp = &bp_pool[i];
+    if (!bp->in_use || bp->pc != pc) continue;
+    if (bp->nr_code > 0) {
+      bool success;
+      if (!expr_run(bp->code, bp->nr_code, &success) && success) continue;
+    }
+    if (!stop) bp_last_hit = i;
+    stop = true;
+    if (g_debug_mode == DEBUG_QUIET) continue;
+    bp->hits ++;
+    printf("Breakpoint[%d] at " FMT_WORD " is hit %" PRIu64 " time(s).\n", i, pc, bp->hits);
+  }
+  if (stop) bp_skip_pc = pc;
+  return stop;
+}
+
+void info_b() {
+  bool empty = true;
+  int i;
+  for (i = 0; i < NR_BP; i ++) {
+    BP *bp = &bp_pool[i];
+    if (!bp->in_use) continue;
+    printf("Breakpoint[%d] at " FMT_WORD ", hit %" PRIu64 " time(s)", i, bp->pc, bp->hits);
+    if (bp->cond[0] != '\0') printf(", if %s", bp->cond);
+    printf("\n");
+    empty = false;
+  }
+  if (empty) printf("There are no breakpoints in use!\n");
+}
@@ -13,291 +13,449 @@
 * See the Mulan PSL v2 for more details.
 ***************************************************************************************/
 
-#include <isa.h>
 
-/* We use the POSIX regex functions to process regular expressions.
- * Type 'man regex' for more information about POSIX regex functions.
- */
-#include <regex.h>
+#include <isa.h>
+#include "sdb.h"
 #include <memory/vaddr.h>
+#include <memory/paddr.h>
+#include <ctype.h>
+#ifdef CONFIG_ELF_SYMBOLS
+#include <ftrace.h>
+#endif
 
 enum {
   TK_NOTYPE = 256, TK_EQ,
 
-  /* TODO: Add more token types */
-  TK_DEC, 
-  TK_HEX, TK_REG, TK_NEQ, TK_AND, TK_OR,
-  DEREF
-};
+  TK_NUM, TK_REG, TK_SYM, TK_NEQ, TK_AND, TK_OR,
+  TK_SHL, TK_SHR, TK_LE, TK_GE, TK_END,
 
-static struct rule {
-  const char *regex;
-  int token_type;
-} rules[] = {
-
-  /* TODO: Add more rules.
-   * Pay attention to the precedence level of different rules.
-   */
-
-  {" +", TK_NOTYPE},              // spaces
-  {"\\+", '+'},                   // plus
-  {"==", TK_EQ},                  // equal
-  {"0[xX][0-9a-fA-F]+", TK_HEX},  // hex
-  {"[0-9]+", TK_DEC},             // dec
-  {"\\*", '*'},                   // mul
-  {"/", '/'},                     // div
-  {"\\(", '('},                   // bra1
-  {"\\)", ')'},                   // bra2
-  {"-", '-'},                     // sub
-  {"\\$((0)|(ra)|(sp)|(gp)|(tp)|(t0)|(t1)|(t2)|(s0)|(s1)|(a0)|(a1)|(a2)|(a3)|(a4)|(a5)|(a6)|(a7)|(s2)|(s3)|(s4)|(s5)|(s6)|(s7)|(s8)|(s9)|(s10)|(s11)|(t3)|(t4)|(t5)|(t6))", TK_REG},
-  {"!=", TK_NEQ},                 // not equal
-  {"&&", TK_AND},                 // and
-  {"\\|\\|", TK_OR},              // or
-  {""}
+  /* unary operators, besides '!' and '~' */
+  DEREF, TK_NEG,
 
+  /* jumps of the compiled code, the target is in `imm' */
+  TK_JZ, TK_JNZ, TK_JMP,
 };
 
-#define NR_REGEX ARRLEN(rules)
-
-static regex_t re[NR_REGEX] = {};
-
-/* Rules are used for many times.
- * Therefore we compile them only once before any usage.
- */
-void init_regex() {
-  int i;
-  char error_msg[128];
-  int ret;
-
-  for (i = 0; i < NR_REGEX; i ++) {
-    ret = regcomp(&re[i], rules[i].regex, REG_EXTENDED);
-    if (ret != 0) {
-      regerror(ret, &re[i], error_msg, 128);
-      panic("regex compilation failed: %s\n%s", error_msg, rules[i].regex);
-    }
-  }
-}
-
 typedef struct token {
   int type;
+  word_t val;
   char str[32];
 } Token;
 
-static Token tokens[32] __attribute__((used)) = {};
-static int nr_token __attribute__((used))  = 0;
+static char *expr_str = NULL;
+static int position = 0;
+static int tok_pos = 0;
+static Token tok = {};
+static bool error = false;
 
-static bool make_token(char *e) {
-  int position = 0;
+static void expr_error(const char *msg) {
+  /* Only the first error is meaningful. */
+  if (!error) {
+    printf("%s at position %d\n%s\n%*s^\n", msg, tok_pos, expr_str, tok_pos, "");
+  }
+  error = true;
+}
+
+/* Scan the next token into `tok'. The expression is scanned only once,
+ * on demand of the parser.
+ */
+static void next_token() {
+  static const struct {
+    char str[3];
+    int type;
+  } ops2[] = {
+    {"==", TK_EQ}, {"!=", TK_NEQ}, {"&&", TK_AND}, {"||", TK_OR},
+    {"<<", TK_SHL}, {">>", TK_SHR}, {"<=", TK_LE}, {">=", TK_GE},
+  };
+  char *s = expr_str + position;
   int i;
-  regmatch_t pmatch;
-
-  nr_token = 0;
-
-  while (e[position] != '\0') {
-    /* Try all rules one by one. */
-    for (i = 0; i < NR_REGEX; i ++) {
-      if (regexec(&re[i], e + position, 1, &pmatch, 0) == 0 && pmatch.rm_so == 0) {
-        char *substr_start = e + position;
-        int substr_len = pmatch.rm_eo;
-
-        Log("match rules[%d] = \"%s\" at position %d with len %d: %.*s",
-            i, rules[i].regex, position, substr_len, substr_len, substr_start);
-
-        position += substr_len;
-
-        /* TODO: Now a new token is recognized with rules[i]. Add codes
-         * to record the token in the array `tokens'. For certain types
-         * of tokens, some extra actions should be performed.
-         */
-
-        switch (rules[i].token_type) {
-          case '+':
-          case '-':
-          case ')':
-          case '(':
-          case '/':
-          case '*':
-          case TK_DEC:
-          case TK_REG:
-          case TK_EQ:
-          case TK_NEQ:
-          case TK_AND:
-          case TK_OR:
-          case TK_HEX:
-            tokens[nr_token].type = rules[i].token_type;
-            strncpy(tokens[nr_token].str, substr_start, substr_len);
-            tokens[nr_token].str[substr_len] = '\0';
-            nr_token++;
-            break;
-          case TK_NOTYPE:
-            break;
-	        default: TODO();
-        }
 
-        break;
-      }
-    }
+  while (isspace(*s)) s ++;
+  tok_pos = position = s - expr_str;
+  tok.type = TK_END;
+
+  if (*s == '\0') return;
+
+  if (isdigit(*s)) {
+    // decimal, hexadecimal and octal as in C, with optional suffixes
+    char *end;
+    tok.val = strtoull(s, &end, 0);
+    while (*end == 'u' || *end == 'U' || *end == 'l' || *end == 'L') end ++;
+    if (isalnum(*end) || *end == '_') { expr_error("bad number"); return; }
+    tok.type = TK_NUM;
+    position = end - expr_str;
+    return;
+  }
 
-    if (i == NR_REGEX) {
-      printf("no match at position %d\n%s\n%*.s^\n", position, e, position, "");
-      return false;
+  if (*s == '$' || isalpha(*s) || *s == '_') {
+    // a register if started with '$', otherwise a symbol
+    int len = 1;
+    while (isalnum(s[len]) || s[len] == '_') len ++;
+    if (len >= sizeof(tok.str)) { expr_error("name too long"); return; }
+    memcpy(tok.str, s, len);
+    tok.str[len] = '\0';
+    tok.type = (*s == '$' ? TK_REG : TK_SYM);
+    position += len;
+    return;
+  }
+
+  for (i = 0; i < ARRLEN(ops2); i ++) {
+    if (s[0] == ops2[i].str[0] && s[1] == ops2[i].str[1]) {
+      tok.type = ops2[i].type;
+      position += 2;
+      return;
     }
   }
 
-  return true;
+  if (strchr("+-*/%<>&^|!~?:()", *s) != NULL) {
+    tok.type = *s;
+    position ++;
+    return;
+  }
+
+  expr_error("unknown character");
 }
 
-bool check_parentheses(int p, int q) {
-  if (tokens[p].type == '(' && tokens[q].type == ')') {
-    int par = 0;
-    for (int i = p; i <= q; i++) {
-      if (tokens[i].type == '(') {
-        par++;
-      } else if (tokens[i].type == ')') {
-        par--;
-      }
-      if (par == 0) {
-        return i == q;
-      }
+static bool sym_lookup(const char *name, word_t *val) {
+#ifdef CONFIG_ELF_SYMBOLS
+  int i;
+  for (i = 0; i < num_functions; i ++) {
+    if (strcmp(functions[i].name, name) == 0) {
+      *val = functions[i].start_addr;
+      return true;
     }
   }
+#endif
   return false;
 }
 
-int find_major(int p, int q) {
-  int ret = -1;
-  int prior = 0;
-  for (int i = p; i <= q; i++) {
-    switch (tokens[i].type) {
-    case TK_AND:
-    case TK_OR:
-      prior = 5;
-      ret = i;
-      break;
-    case TK_EQ:
-    case TK_NEQ:
-      if (prior > 4) {
-        break;
-      } else {
-        prior = 4;
-        ret = i;
-      }
-    case '+':
-    case '-':
-      if (prior > 3) {
-        break;
-      } else {
-        prior = 3;
-        ret = i;
-      }
-    case '*':
+/* Values are signed as `int' in C, so `7 - 10 < 0' and `-1 / 2' work
+ * as expected. Shifts and the other bitwise operators are unsigned.
+ */
+static word_t calc(int op, word_t val1, word_t val2, bool *success) {
+  const int shmask = sizeof(word_t) * 8 - 1;
+  sword_t s1 = val1, s2 = val2;
+  switch (op) {
+    case '+': return val1 + val2;
+    case '-': return val1 - val2;
+    case '*': return val1 * val2;
     case '/':
-      if (prior > 2) {
-        break;
-      } else {
-        prior = 2;
-        ret = i;
-      }
+    case '%':
+      if (val2 == 0) { *success = false; return 0; }
+      // the minimum divided by -1 overflows, which traps on the host
+      if (s2 == -1) return (op == '/' ? -val1 : 0);
+      return (op == '/' ? s1 / s2 : s1 % s2);
+    case TK_SHL: return val1 << (val2 & shmask);
+    case TK_SHR: return val1 >> (val2 & shmask);
+    case '<':    return (s1 < s2);
+    case '>':    return (s1 > s2);
+    case TK_LE:  return (s1 <= s2);
+    case TK_GE:  return (s1 >= s2);
+    case TK_EQ:  return (val1 == val2);
+    case TK_NEQ: return (val1 != val2);
+    case '&':    return val1 & val2;
+    case '^':    return val1 ^ val2;
+    case '|':    return val1 | val2;
+    case TK_AND: return (val1 && val2);
+    case TK_OR:  return (val1 || val2);
+    case TK_NEG: return -val1;
+    case '!':    return !val1;
+    case '~':    return ~val1;
+    default: assert(0);
+  }
+}
+
+/* The AST. Subtrees without registers and memory are folded into
+ * constants as soon as they are built.
+ */
+typedef struct {
+  int op;
+  bool is_const;
+  word_t val;
+  const word_t *reg;
+  int child[3];
+} Node;
+
+#define NR_NODE 256
+
+static Node nodes[NR_NODE];
+static int nr_node = 0;
+
+static int new_node(int op, int c0, int c1, int c2) {
+  if (nr_node == NR_NODE) { expr_error("expression too long"); return -1; }
+  Node *n = &nodes[nr_node];
+  *n = (Node){ .op = op, .child = { c0, c1, c2 } };
+  return nr_node ++;
+}
+
+static int leaf(int op, word_t val, const word_t *reg) {
+  int idx = new_node(op, -1, -1, -1);
+  if (idx < 0) return -1;
+  nodes[idx].is_const = (op == TK_NUM);
+  nodes[idx].val = val;
+  nodes[idx].reg = reg;
+  return idx;
+}
+
+static int unary(int op, int c) {
+  int idx = new_node(op, c, -1, -1);
+  if (idx < 0) return -1;
+  Node *n = &nodes[idx], *a = &nodes[c];
+  if (op != DEREF && a->is_const) {
+    bool ok = true;
+    n->val = calc(op, a->val, 0, &ok);
+    n->is_const = true;
+  }
+  return idx;
+}
+
+static int binary(int op, int c0, int c1) {
+  int idx = new_node(op, c0, c1, -1);
+  if (idx < 0) return -1;
+  Node *n = &nodes[idx], *a = &nodes[c0], *b = &nodes[c1];
+  if ((op == TK_AND || op == TK_OR) && a->is_const && (a->val != 0) == (op == TK_OR)) {
+    // short circuit
+    n->val = (op == TK_OR);
+    n->is_const = true;
+  } else if (a->is_const && b->is_const) {
+    // a division by zero is left to fail at run time
+    bool ok = true;
+    n->val = calc(op, a->val, b->val, &ok);
+    n->is_const = ok;
+  }
+  return idx;
+}
+
+static int prec_of(int type) {
+  switch (type) {
+    case '?':    return 1;
+    case TK_OR:  return 2;
+    case TK_AND: return 3;
+    case '|':    return 4;
+    case '^':    return 5;
+    case '&':    return 6;
+    case TK_EQ: case TK_NEQ: return 7;
+    case '<': case '>': case TK_LE: case TK_GE: return 8;
+    case TK_SHL: case TK_SHR: return 9;
+    case '+': case '-': return 10;
+    case '*': case '/': case '%': return 11;
+    default: return 0;
+  }
+}
+
+static int parse(int min_prec);
+
+static int parse_unary() {
+  int type = tok.type;
+  int idx;
+  word_t val = 0;
+
+  switch (type) {
+    case TK_NUM:
+      idx = leaf(TK_NUM, tok.val, NULL);
       break;
-    case DEREF:
-      if (prior > 1) {
-        break;
-      } else {
-        prior = 1;
-        ret = i;
-      }
+    case TK_REG: {
+      const word_t *reg = isa_reg_str2ptr(tok.str);
+      if (reg == NULL) { expr_error("unknown register"); return -1; }
+      idx = leaf(TK_REG, 0, reg);
+      break;
+    }
+    case TK_SYM:
+      if (!sym_lookup(tok.str, &val)) { expr_error("unknown symbol"); return -1; }
+      idx = leaf(TK_NUM, val, NULL);
       break;
     case '(':
-      do {
-        i++;
-      } while (tokens[i].type != ')' && i <= q);
+      next_token();
+      idx = parse(1);
+      if (idx < 0) return -1;
+      if (tok.type != ')') { expr_error("expect ')'"); return -1; }
       break;
+    case '+':
+      next_token();
+      return parse_unary();
+    case '-': case '*': case '!': case '~':
+      next_token();
+      idx = parse_unary();
+      if (idx < 0) return -1;
+      return unary(type == '-' ? TK_NEG : (type == '*' ? DEREF : type), idx);
     default:
-      break;
+      expr_error("expect an operand");
+      return -1;
+  }
+  next_token();
+  return idx;
+}
+
+/* Pratt parser for binary operators with precedence at least `min_prec'.
+ * Binary operators are left associative, while `?:' is right associative.
+ */
+static int parse(int min_prec) {
+  int l = parse_unary();
+
+  while (l >= 0) {
+    int op = tok.type;
+    int prec = prec_of(op);
+    if (prec == 0 || prec < min_prec) break;
+    next_token();
+
+    if (op == '?') {
+      int t = parse(1);
+      if (t < 0) return -1;
+      if (tok.type != ':') { expr_error("expect ':'"); return -1; }
+      next_token();
+      int f = parse(prec);
+      if (f < 0) return -1;
+      if (nodes[l].is_const) l = (nodes[l].val ? t : f);
+      else if ((l = new_node('?', l, t, f)) < 0) return -1;
+    } else {
+      int r = parse(prec + 1);
+      if (r < 0) return -1;
+      l = binary(op, l, r);
     }
   }
-  return ret;
+  return l;
 }
 
+static ExprOp *code = NULL;
+static int nr_code = 0;
 
-word_t eval(int p, int q, bool *ok) {
-  *ok = true;
-  if (p > q) {
-    /* Bad expression */
-    *ok = false;
-    return 0;
-  } else if (p == q) {
-    /* Single token.
-     * For now this token should be a number.
-     * Return the value of the number.
-     */
-    word_t ret;
-    switch (tokens[p].type) {
-    case TK_DEC:
-      ret = strtol(tokens[p].str, NULL, 10);
-      return ret;
-    case TK_HEX:
-      ret = strtol(tokens[p].str, NULL, 16);
-      return ret;
+static int emit(int op, word_t imm, const word_t *reg) {
+  if (nr_code == NR_EXPR_OP) { expr_error("expression too long"); return -1; }
+  code[nr_code] = (ExprOp){ .op = op, .imm = imm, .reg = reg };
+  return nr_code ++;
+}
+
+/* Generate the code of the AST for a stack machine in postfix order.
+ * Registers are resolved to their storage here, so the code can be run
+ * again and again without looking at the string.
+ */
+static bool gen(int idx) {
+  Node *n = &nodes[idx];
+  int j1, j2, j3, i;
+
+  if (n->is_const) return emit(TK_NUM, n->val, NULL) >= 0;
+
+  switch (n->op) {
     case TK_REG:
-      ret = isa_reg_str2val(tokens[p].str, ok);
-      return ret;
-    default:
-      *ok = false;
-      return 0;
+      return emit(TK_REG, 0, n->reg) >= 0;
+    case TK_AND:
+    case TK_OR: {
+      /* a && b:  a; jz F; b; jz F; 1; jmp E; F: 0; E:
+       * a || b is the same with jnz and the values swapped.
+       */
+      int jop = (n->op == TK_AND ? TK_JZ : TK_JNZ);
+      if (!gen(n->child[0]) || (j1 = emit(jop, 0, NULL)) < 0 ||
+          !gen(n->child[1]) || (j2 = emit(jop, 0, NULL)) < 0 ||
+          emit(TK_NUM, n->op == TK_AND, NULL) < 0 || (j3 = emit(TK_JMP, 0, NULL)) < 0 ||
+          emit(TK_NUM, n->op == TK_OR, NULL) < 0) return false;
+      code[j1].imm = code[j2].imm = j3 + 1;
+      code[j3].imm = nr_code;
+      return true;
     }
-  } else if (check_parentheses(p, q) == true) {
-    /* The expression is surrounded by a matched pair of parentheses.
-     * If that is the case, just throw away the parentheses.
-     */
-    return eval(p + 1, q - 1, ok);
-  } else {
-    /* We should do more things here. */
-    int op = find_major(p, q);
-
-    bool ok;
-    vaddr_t addr;
-    int result;
-    switch (tokens[op].type) {
-      case DEREF:
-        addr = eval(p + 1, q, &ok);
-        result = vaddr_read(addr,4);
-        return result;
-      default:
-        break;
+    case '?':
+      // c ? t : f:  c; jz F; t; jmp E; F: f; E:
+      if (!gen(n->child[0]) || (j1 = emit(TK_JZ, 0, NULL)) < 0 ||
+          !gen(n->child[1]) || (j2 = emit(TK_JMP, 0, NULL)) < 0 ||
+          !gen(n->child[2])) return false;
+      code[j1].imm = j2 + 1;
+      code[j2].imm = nr_code;
+      return true;
+    default:
+      for (i = 0; i < 3 && n->child[i] >= 0; i ++) {
+        if (!gen(n->child[i])) return false;
+      }
+      return emit(n->op, 0, NULL) >= 0;
+  }
+}
+
+/* Find out the registers and memory read by the AST. The address of a
+ * dereference must be a constant in pmem, otherwise the expression has
+ * to be evaluated after every instruction.
+ */
+static void deps_of(int idx, ExprDeps *deps) {
+  Node *n = &nodes[idx];
+  int i;
+
+  if (n->is_const) return;
+
+  if (n->op == TK_REG) {
+    int r = n->reg - cpu.gpr;
+    if (r >= 0 && r < ARRLEN(cpu.gpr)) deps->reg_mask |= 1ull << r;
+    else deps->poll = true;
+    return;
+  }
+
+  if (n->op == DEREF) {
+    Node *a = &nodes[n->child[0]];
+    word_t addr = a->val;
+    if (a->is_const && in_pmem(addr) && in_pmem(addr + 3) &&
+        isa_mmu_check(addr, 4, MEM_TYPE_READ) == MMU_DIRECT) {
+      deps->mem[deps->nr_mem ++] = addr;
+      return;
     }
+    deps->poll = true;
+  }
+
+  for (i = 0; i < 3 && n->child[i] >= 0; i ++) {
+    deps_of(n->child[i], deps);
+  }
+}
+
+int expr_compile(char *e, ExprOp *buf, ExprDeps *deps) {
+  expr_str = e;
+  position = 0;
+  error = false;
+  nr_node = 0;
+
+  next_token();
+  int root = parse(1);
+  if (root >= 0 && tok.type != TK_END) expr_error("unexpected token");
+  if (error || root < 0) return -1;
 
-    int val1 = eval(p, op - 1, &ok);
-    int val2 = eval(op + 1, q, &ok);
-
-    switch(tokens[op].type) {
-      case '+': return val1 + val2;
-      case '-': return val1 - val2;
-      case '*': return val1 * val2;
-      case '/': return val1 / val2;
-      case TK_NEQ: return (val1 != val2);
-      case TK_EQ:  return (val1 == val2);
-      case TK_AND: return (val1 && val2);
-      case TK_OR:  return (val1 || val2);
-      default: assert(0);
+  code = buf;
+  nr_code = 0;
+  if (!gen(root)) return -1;
+
+  if (deps != NULL) {
+    *deps = (ExprDeps){};
+    deps_of(root, deps);
+  }
+  return nr_code;
+}
+
+word_t expr_run(const ExprOp *buf, int n, bool *success) {
+  word_t stack[NR_EXPR_OP];
+  int top = 0;
+  int pc;
+
+  *success = true;
+  for (pc = 0; pc < n; pc ++) {
+    const ExprOp *op = &buf[pc];
+    switch (op->op) {
+      case TK_NUM: stack[top ++] = op->imm; break;
+      case TK_REG: stack[top ++] = *op->reg; break;
+      case DEREF: stack[top - 1] = vaddr_read(stack[top - 1], 4); break;
+      case TK_NEG: case '!': case '~':
+        stack[top - 1] = calc(op->op, stack[top - 1], 0, success);
+        break;
+      case TK_JZ:  if (stack[-- top] == 0) pc = op->imm - 1; break;
+      case TK_JNZ: if (stack[-- top] != 0) pc = op->imm - 1; break;
+      case TK_JMP: pc = op->imm - 1; break;
+      default:
+        top --;
+        stack[top - 1] = calc(op->op, stack[top - 1], stack[top], success);
+        if (!*success) return 0;
     }
   }
+  return stack[0];
 }
 
 word_t expr(char *e, bool *success) {
-  if (!make_token(e)) {
+  ExprOp buf[NR_EXPR_OP];
+  int n = expr_compile(e, buf, NULL);
+  if (n < 0) {
     *success = false;
     return 0;
   }
-
-  /* TODO: Insert codes to evaluate the expression. */
-  for (int i = 0; i < nr_token; i++) {
-    if (tokens[i].type == '*') {
-      if ((i == 0) || (tokens[i - 1].type != TK_DEC && tokens[i - 1].type != ')')) {
-        tokens[i].type = DEREF;
-      }
-    }
-  }
-  *success = true;
-  return eval(0, nr_token - 1, success);
+  return expr_run(buf, n, success);
 }
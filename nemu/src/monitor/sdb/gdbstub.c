@@ -0,0 +1,447 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <isa.h>
+#include <cpu/cpu.h>
+#include <memory/vaddr.h>
+#include <memory/paddr.h>
+#include <cpu/reverse.h>
+#include "sdb.h"
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+/* A stub of the GDB remote serial protocol. The guest is controlled by a
+ * GDB connected to the TCP port (or the Unix socket) given by `--gdb`.
+ * Breakpoints and watchpoints of GDB are mapped to those of sdb, so the
+ * guest runs at full speed between two stops.
+ */
+
+// the connection is polled for a Ctrl-C every this many instructions
+#define GDB_POLL_INTERVAL 100000
+#define GDB_PACKET_SIZE 4096
+#define NR_GDB_POINT 64
+
+extern uint64_t g_nr_guest_inst;
+int new_bp(vaddr_t pc, char *cond);
+bool free_bp(int n);
+
+static const char *gdb_addr = NULL;
+static int conn = -1;
+
+// breakpoints and watchpoints set up by GDB
+static struct {
+  int type;   // 0 for breakpoints, 2 for write watchpoints, -1 if not in use
+  vaddr_t addr;
+  int NO;     // NO in sdb
+} points[NR_GDB_POINT];
+
+void sdb_set_gdb_mode(const char *addr) {
+  gdb_addr = addr;
+}
+
+bool sdb_is_gdb_mode() {
+  return gdb_addr != NULL;
+}
+
+static int gdb_listen() {
+  int fd;
+  char *end;
+  long port = strtol(gdb_addr, &end, 10);
+
+  if (*end == '\0') {
+    struct sockaddr_in sa = {
+      .sin_family = AF_INET,
+      .sin_port = htons(port),
+      .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    int one = 1;
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    Assert(fd >= 0, "Can not create the socket");
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    Assert(bind(fd, (struct sockaddr *)&sa, sizeof(sa)) == 0, "Can not bind to port %ld", port);
+  } else {
+    struct sockaddr_un sa = { .sun_family = AF_UNIX };
+    strncpy(sa.sun_path, gdb_addr, sizeof(sa.sun_path) - 1);
+    unlink(gdb_addr);
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    Assert(fd >= 0, "Can not create the socket");
+    Assert(bind(fd, (struct sockaddr *)&sa, sizeof(sa)) == 0, "Can not bind to %s", gdb_addr);
+  }
+  Assert(listen(fd, 1) == 0, "Can not listen on %s", gdb_addr);
+  Log("Waiting for GDB on %s", gdb_addr);
+
+  int c = accept(fd, NULL, NULL);
+  Assert(c >= 0, "Can not accept the connection");
+  close(fd);
+  if (*end == '\0') {
+    int one = 1;
+    setsockopt(c, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  }
+  Log("GDB is connected");
+  return c;
+}
+
+// --- packets ---
+
+static int get_char() {
+  uint8_t c;
+  return (read(conn, &c, 1) == 1 ? c : -1);
+}
+
+static int hex_val(int c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+static const char hex_digit[] = "0123456789abcdef";
+
+// receive a packet into `buf`, return its length or -1 if disconnected
+static int recv_packet(char *buf) {
+  int c;
+  while (true) {
+    do {
+      c = get_char();
+      if (c < 0) return -1;
+    } while (c != '$');
+
+    uint8_t sum = 0;
+    int len = 0;
+    while ((c = get_char()) >= 0 && c != '#') {
+      if (len < GDB_PACKET_SIZE - 1) buf[len ++] = c;
+      sum += c;
+    }
+    int hi = get_char(), lo = get_char();
+    if (c < 0 || hi < 0 || lo < 0) return -1;
+    buf[len] = '\0';
+
+    bool ok = ((hex_val(hi) << 4) | hex_val(lo)) == sum;
+    if (write(conn, ok ? "+" : "-", 1) != 1) return -1;
+    if (ok) return len;
+  }
+}
+
+static void send_packet(const char *data) {
+  static char buf[GDB_PACKET_SIZE + 4];
+  uint8_t sum = 0;
+  int len = 0;
+  buf[len ++] = '$';
+  for (; *data != '\0'; data ++) {
+    buf[len ++] = *data;
+    sum += *data;
+  }
+  buf[len ++] = '#';
+  buf[len ++] = hex_digit[sum >> 4];
+  buf[len ++] = hex_digit[sum & 0xf];
+
+  int c;
+  do {
+    if (write(conn, buf, len) != len) return;
+    c = get_char();
+  } while (c == '-');
+}
+
+static char *put_hex(char *p, word_t val, int nbyte) {
+  // little-endian, as GDB expects for the register and memory contents
+  for (int i = 0; i < nbyte; i ++, val >>= 8) {
+    *p ++ = hex_digit[(val >> 4) & 0xf];
+    *p ++ = hex_digit[val & 0xf];
+  }
+  *p = '\0';
+  return p;
+}
+
+static word_t get_hex_le(const char **p, int nbyte) {
+  word_t val = 0;
+  for (int i = 0; i < nbyte; i ++) {
+    int hi = hex_val((*p)[0]), lo = hex_val((*p)[1]);
+    if (hi < 0 || lo < 0) break;
+    val |= (word_t)((hi << 4) | lo) << (i * 8);
+    *p += 2;
+  }
+  return val;
+}
+
+// --- registers and memory ---
+
+#define NR_GDB_REG (ARRLEN(cpu.gpr) + 1) // general purpose registers and pc
+
+static word_t gdb_reg(int idx) {
+  return (idx < ARRLEN(cpu.gpr) ? cpu.gpr[idx] : cpu.pc);
+}
+
+static void gdb_set_reg(int idx, word_t val) {
+  // register 0 is hard-wired to zero, writes to it are ignored
+  if (idx == 0) return;
+  if (idx < ARRLEN(cpu.gpr)) cpu.gpr[idx] = val;
+  else cpu.pc = val;
+}
+
+// parse "ADDR,LEN", return the character after it or NULL if malformed
+static const char *get_range(const char *args, vaddr_t *addr, word_t *len) {
+  char *end;
+  *addr = strtoull(args, &end, 16);
+  if (*end != ',') return NULL;
+  *len = strtoull(end + 1, &end, 16);
+  return end;
+}
+
+// memory out of pmem is not accessed, to avoid the side effect of devices
+static bool mem_ok(vaddr_t addr, word_t len) {
+  return len <= GDB_PACKET_SIZE / 2 && in_pmem(addr) && (len == 0 || in_pmem(addr + len - 1));
+}
+
+static void read_mem(const char *args, char *reply) {
+  vaddr_t addr;
+  word_t len;
+  if (get_range(args, &addr, &len) == NULL || !mem_ok(addr, len)) {
+    strcpy(reply, "E14");
+    return;
+  }
+  for (word_t i = 0; i < len; i ++) reply = put_hex(reply, vaddr_read(addr + i, 1), 1);
+}
+
+static void write_mem(const char *args, char *reply) {
+  vaddr_t addr;
+  word_t len;
+  const char *data = get_range(args, &addr, &len);
+  if (data == NULL || *data != ':' || !mem_ok(addr, len)) {
+    strcpy(reply, "E14");
+    return;
+  }
+  // go through the store path, so that snapshots and watchpoints see it
+  data ++;
+  for (word_t i = 0; i < len; i ++) vaddr_write(addr + i, 1, get_hex_le(&data, 1));
+  strcpy(reply, "OK");
+}
+
+// --- breakpoints and watchpoints ---
+
+static void free_point(int i) {
+  if (points[i].type == 0) free_bp(points[i].NO);
+  else free_wp(points[i].NO);
+  points[i].type = -1;
+}
+
+static int alloc_point() {
+  int i;
+  for (i = 0; i < NR_GDB_POINT && points[i].type != -1; i ++);
+  return (i < NR_GDB_POINT ? i : -1);
+}
+
+/* Watch the bytes [addr, addr + len). The store path only triggers for
+ * whole words in pmem, so there is one watchpoint for each aligned word,
+ * masked to the bytes requested in it.
+ */
+static bool set_watch(vaddr_t addr, word_t len) {
+  if (len == 0 || !in_pmem(addr) || !in_pmem(addr + len - 1)) return false;
+
+  int idx[NR_GDB_POINT], n = 0;
+  vaddr_t w;
+  for (w = addr & ~(vaddr_t)3; w < addr + len; w += 4) {
+    int lo = (w < addr ? addr - w : 0);
+    int hi = (w + 4 > addr + len ? addr + len - w : 4);
+    uint32_t mask = (hi == 4 ? ~0u : (1u << hi * 8) - 1) & ~((1u << lo * 8) - 1);
+    char e[48];
+    snprintf(e, sizeof(e), "*0x%" PRIx64 " & 0x%08x", (uint64_t)w, mask);
+
+    int i = alloc_point();
+    WP *wp = (i >= 0 ? set_wp(e) : NULL);
+    if (wp == NULL) {
+      while (n > 0) free_point(idx[-- n]);
+      return false;
+    }
+    points[i].type = 2;
+    points[i].addr = addr;
+    points[i].NO = wp->NO;
+    idx[n ++] = i;
+  }
+  return true;
+}
+
+static void set_point(const char *args, char *reply, bool insert) {
+  vaddr_t addr;
+  word_t kind;
+  int type = args[0] - '0';
+  if (args[1] != ',' || get_range(args + 2, &addr, &kind) == NULL) {
+    strcpy(reply, "E01");
+    return;
+  }
+  // only breakpoints and write watchpoints are supported
+  if (type == 1) type = 0;
+  if (type != 0 && !(type == 2 && ISDEF(CONFIG_WATCHPOINT))) {
+    reply[0] = '\0';
+    return;
+  }
+
+  int i;
+  if (!insert) {
+    for (i = 0; i < NR_GDB_POINT; i ++) {
+      if (points[i].type == type && points[i].addr == addr) free_point(i);
+    }
+    strcpy(reply, "OK");
+    return;
+  }
+
+  if (type == 2) {
+    strcpy(reply, set_watch(addr, kind) ? "OK" : "E0E");
+    return;
+  }
+
+  i = alloc_point();
+  int NO = (i >= 0 ? new_bp(addr, NULL) : -1);
+  if (NO < 0) {
+    strcpy(reply, "E0E");
+    return;
+  }
+  points[i].type = type;
+  points[i].addr = addr;
+  points[i].NO = NO;
+  strcpy(reply, "OK");
+}
+
+// --- execution ---
+
+static bool interrupted() {
+  struct pollfd pfd = { .fd = conn, .events = POLLIN };
+  if (poll(&pfd, 1, 0) <= 0) return false;
+  return get_char() == 0x03;
+}
+
+static void stop_reply(char *reply, int sig) {
+  switch (nemu_state.state) {
+    case NEMU_END: sprintf(reply, "W%02x", nemu_state.halt_ret & 0xff); return;
+    case NEMU_ABORT: strcpy(reply, "X06"); return;
+  }
+
+  int i;
+  for (i = 0; wp_last_hit >= 0 && i < NR_GDB_POINT; i ++) {
+    if (points[i].type == 2 && points[i].NO == wp_last_hit) {
+      sprintf(reply, "T%02xwatch:%" PRIx64 ";", sig, (uint64_t)points[i].addr);
+      return;
+    }
+  }
+  sprintf(reply, "S%02x", sig);
+}
+
+static void gdb_exec(const char *args, char *reply, bool step) {
+  if (*args != '\0') cpu.pc = strtoul(args, NULL, 16);
+  wp_last_hit = -1;
+
+  if (step) {
+    cpu_exec(1);
+    stop_reply(reply, 5);
+    return;
+  }
+
+  while (true) {
+    uint64_t start = g_nr_guest_inst;
+    cpu_exec(GDB_POLL_INTERVAL);
+    if (nemu_state.state != NEMU_STOP) break;
+    // stopped by a breakpoint or a watchpoint
+    if (g_nr_guest_inst - start < GDB_POLL_INTERVAL || wp_last_hit >= 0) break;
+    if (interrupted()) {
+      stop_reply(reply, 2);
+      return;
+    }
+  }
+  stop_reply(reply, 5);
+}
+
+static bool gdb_handle(char *pkt, char *reply) {
+  char *p = reply;
+  int i;
+  word_t val;
+  const char *q;
+
+  reply[0] = '\0';
+  switch (pkt[0]) {
+    case '?': stop_reply(reply, 5); break;
+    case 'g':
+      for (i = 0; i < NR_GDB_REG; i ++) p = put_hex(p, gdb_reg(i), sizeof(word_t));
+      break;
+    case 'G':
+      for (i = 0, q = pkt + 1; i < NR_GDB_REG; i ++) gdb_set_reg(i, get_hex_le(&q, sizeof(word_t)));
+      strcpy(reply, "OK");
+      break;
+    case 'p':
+      i = strtol(pkt + 1, NULL, 16);
+      if (i < NR_GDB_REG) put_hex(reply, gdb_reg(i), sizeof(word_t));
+      else strcpy(reply, "E01");
+      break;
+    case 'P':
+      i = strtol(pkt + 1, (char **)&q, 16);
+      if (i < NR_GDB_REG && *q == '=') {
+        q ++;
+        val = get_hex_le(&q, sizeof(word_t));
+        gdb_set_reg(i, val);
+        strcpy(reply, "OK");
+      } else strcpy(reply, "E01");
+      break;
+    case 'm': read_mem(pkt + 1, reply); break;
+    case 'M': write_mem(pkt + 1, reply); break;
+    case 'c': gdb_exec(pkt + 1, reply, false); break;
+    case 's': gdb_exec(pkt + 1, reply, true); break;
+#ifdef CONFIG_REVERSE
+    case 'b':
+      wp_last_hit = -1;
+      if (pkt[1] == 's') reverse_step(1);
+      else if (pkt[1] == 'c') reverse_continue();
+      else break;
+      stop_reply(reply, 5);
+      break;
+#endif
+    case 'Z': set_point(pkt + 1, reply, true); break;
+    case 'z': set_point(pkt + 1, reply, false); break;
+    case 'H': strcpy(reply, "OK"); break;
+    case 'D': strcpy(reply, "OK"); send_packet(reply); return false;
+    case 'k': cpu_quit(); return false;
+    case 'q':
+      if (strncmp(pkt, "qSupported", 10) == 0) {
+        sprintf(reply, "PacketSize=%x%s", GDB_PACKET_SIZE,
+            MUXDEF(CONFIG_REVERSE, ";ReverseStep+;ReverseContinue+", ""));
+      }
+      else if (strcmp(pkt, "qAttached") == 0) strcpy(reply, "1");
+      else if (strcmp(pkt, "qC") == 0) strcpy(reply, "QC1");
+      else if (strcmp(pkt, "qfThreadInfo") == 0) strcpy(reply, "m1");
+      else if (strcmp(pkt, "qsThreadInfo") == 0) strcpy(reply, "l");
+      break;
+    default: break; // unsupported, reply with an empty packet
+  }
+  return true;
+}
+
+void gdb_mainloop() {
+  static char pkt[GDB_PACKET_SIZE], reply[GDB_PACKET_SIZE + 1];
+  int i;
+  for (i = 0; i < NR_GDB_POINT; i ++) points[i].type = -1;
+
+  conn = gdb_listen();
+  while (recv_packet(pkt) >= 0) {
+    if (!gdb_handle(pkt, reply)) break;
+    send_packet(reply);
+  }
+  close(conn);
+  Log("GDB is disconnected");
+
+  // let the guest run to the end after detaching
+  if (nemu_state.state == NEMU_STOP) cpu_exec(-1);
+}
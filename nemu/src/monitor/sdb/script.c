@@ -0,0 +1,298 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <unistd.h>
+#include <isa.h>
+#include <cpu/cpu.h>
+#include <memory/vaddr.h>
+#include <memory/paddr.h>
+#include <memory/snapshot.h>
+#include <cpu/breakpoint.h>
+#include "sdb.h"
+
+/* Run sdb commands from a file without any interaction. The result of each
+ * command is a JSON object in one line, written to `--script-out` (stdout by
+ * default), so that it can be parsed easily. Every object has the command
+ * as "cmd", and "error" if the command fails. `si` and `c` tell why the
+ * execution stops in "reason": "step", "watchpoint" or "breakpoint" with
+ * its "id", "trap" or "abort". When the results go to stdout,
+ * everything else NEMU prints is moved to stderr, so that only JSON is left.
+ */
+
+extern uint64_t g_nr_guest_inst;
+int new_bp(vaddr_t pc, char *cond);
+bool free_bp(int n);
+
+static const char *script_file = NULL;
+static FILE *out = NULL;
+
+void sdb_set_script(const char *file, const char *out_file) {
+  script_file = file;
+  if (out_file != NULL) {
+    out = fopen(out_file, "w");
+    Assert(out, "Can not open '%s'", out_file);
+    return;
+  }
+  // keep the original stdout for the results, and send the logs,
+  // the traces and the output of the guest to stderr
+  fflush(stdout);
+  int fd = dup(STDOUT_FILENO);
+  Assert(fd >= 0 && dup2(STDERR_FILENO, STDOUT_FILENO) >= 0, "Can not redirect stdout");
+  out = fdopen(fd, "w");
+  Assert(out, "Can not open the results on stdout");
+}
+
+bool sdb_is_script_mode() {
+  return script_file != NULL;
+}
+
+static void json_str(const char *s) {
+  fputc('"', out);
+  for (; *s != '\0'; s ++) {
+    if (*s == '"' || *s == '\\') fprintf(out, "\\%c", *s);
+    else if ((unsigned char)*s < 0x20) fprintf(out, "\\u%04x", *s);
+    else fputc(*s, out);
+  }
+  fputc('"', out);
+}
+
+static void json_word(const char *key, word_t val) {
+  fprintf(out, ",\"%s\":\"" FMT_WORD "\"", key, val);
+}
+
+static void json_error(const char *msg) {
+  fprintf(out, ",\"error\":");
+  json_str(msg);
+}
+
+static const char *state_name() {
+  switch (nemu_state.state) {
+    case NEMU_RUNNING: return "running";
+    case NEMU_STOP: return "stop";
+    case NEMU_END: return "end";
+    case NEMU_ABORT: return "abort";
+    default: return "quit";
+  }
+}
+
+static void json_state() {
+  fprintf(out, ",\"state\":\"%s\",\"nr_inst\":%" PRIu64, state_name(), g_nr_guest_inst);
+  json_word("pc", cpu.pc);
+  if (nemu_state.state == NEMU_END || nemu_state.state == NEMU_ABORT) {
+    fprintf(out, ",\"halt_ret\":%u", nemu_state.halt_ret);
+  }
+}
+
+static void exec_and_report(uint64_t n) {
+  wp_last_hit = -1;
+  IFDEF(CONFIG_BREAKPOINT, bp_last_hit = -1);
+  cpu_exec(n);
+  json_state();
+
+  const char *reason = "step";
+  int id = -1;
+  switch (nemu_state.state) {
+    case NEMU_END: reason = "trap"; break;
+    case NEMU_ABORT: reason = "abort"; break;
+    default:
+      if (wp_last_hit >= 0) { reason = "watchpoint"; id = wp_last_hit; }
+      IFDEF(CONFIG_BREAKPOINT, else if (bp_last_hit >= 0) { reason = "breakpoint"; id = bp_last_hit; })
+  }
+  fprintf(out, ",\"reason\":\"%s\"", reason);
+  if (id >= 0) fprintf(out, ",\"id\":%d", id);
+}
+
+static void script_si(char *args) {
+  exec_and_report(args == NULL ? 1 : strtoull(args, NULL, 0));
+}
+
+static void script_c(char *args) {
+  exec_and_report(-1);
+}
+
+static void script_info(char *args) {
+  if (args == NULL || strcmp(args, "r") != 0) {
+    json_error("only registers (info r) are supported");
+    return;
+  }
+  int i;
+  fprintf(out, ",\"gpr\":[");
+  for (i = 0; i < ARRLEN(cpu.gpr); i ++) {
+    fprintf(out, "%s\"" FMT_WORD "\"", (i == 0 ? "" : ","), cpu.gpr[i]);
+  }
+  fprintf(out, "]");
+  json_word("pc", cpu.pc);
+}
+
+static void script_x(char *args) {
+  char *arg = (args == NULL ? NULL : strtok(args, " "));
+  char *e = (arg == NULL ? NULL : strtok(NULL, ""));
+  bool success = false;
+  vaddr_t addr = (e == NULL ? 0 : expr(e, &success));
+  int i, n = (arg == NULL ? 0 : atoi(arg));
+  if (!success || n <= 0) {
+    json_error("usage: x N EXPR");
+    return;
+  }
+  // only untranslated pmem is read, since a bad address would abort NEMU
+  bool ok = (n <= CONFIG_MSIZE / 4);
+  for (i = 0; ok && i < n; i ++) {
+    vaddr_t a = addr + i * 4;
+    ok = in_pmem(a) && in_pmem(a + 3) && isa_mmu_check(a, 4, MEM_TYPE_READ) == MMU_DIRECT;
+  }
+  if (!ok) {
+    json_error("address out of pmem");
+    return;
+  }
+  json_word("addr", addr);
+  fprintf(out, ",\"data\":[");
+  for (i = 0; i < n; i ++) {
+    fprintf(out, "%s\"" FMT_WORD "\"", (i == 0 ? "" : ","), vaddr_read(addr + i * 4, 4));
+  }
+  fprintf(out, "]");
+}
+
+static void script_p(char *args) {
+  bool success = false;
+  word_t val = (args == NULL ? 0 : expr(args, &success));
+  if (!success) json_error("invalid expression");
+  else json_word("value", val);
+}
+
+static void script_w(char *args) {
+  WP *wp = (args == NULL ? NULL : set_wp(args));
+  if (wp == NULL) json_error("invalid expression");
+  else fprintf(out, ",\"id\":%d", wp->NO);
+}
+
+static void script_d(char *args) {
+  int n;
+  if (args == NULL || sscanf(args, "%d", &n) != 1 || get_wp(n) == NULL) json_error("no such watchpoint");
+  else free_wp(n);
+}
+
+#ifdef CONFIG_BREAKPOINT
+static void script_b(char *args) {
+  char *cond = (args == NULL ? NULL : strstr(args, " if "));
+  if (cond != NULL) {
+    *cond = '\0';
+    cond += 4;
+  }
+  bool success = false;
+  vaddr_t pc = (args == NULL ? 0 : expr(args, &success));
+  int n = (success ? new_bp(pc, cond) : -1);
+  if (n < 0) json_error("can not set up the breakpoint");
+  else fprintf(out, ",\"id\":%d", n);
+}
+
+static void script_bd(char *args) {
+  int n;
+  if (args == NULL || sscanf(args, "%d", &n) != 1 || !free_bp(n)) json_error("no such breakpoint");
+}
+#endif
+
+#ifdef CONFIG_SNAPSHOT
+static void script_save(char *args) {
+  int idx = snapshot_take(true);
+  if (idx < 0) {
+    json_error("too many snapshots are saved");
+    return;
+  }
+  fprintf(out, ",\"id\":%d,\"nr_inst\":%" PRIu64, idx, snapshot_nr_inst(idx));
+}
+
+static void script_load(char *args) {
+  int idx = snapshot_count() - 1;
+  if (args != NULL) sscanf(args, "%d", &idx);
+  if (idx < 0 || idx >= snapshot_count()) {
+    json_error("no such snapshot");
+    return;
+  }
+  snapshot_restore(idx);
+  nemu_state.state = NEMU_STOP;
+  IFDEF(CONFIG_BREAKPOINT, bp_skip_pc = cpu.pc);
+  json_state();
+}
+#endif
+
+static void script_stat(char *args) {
+  uint64_t us = cpu_host_time();
+  fprintf(out, ",\"nr_inst\":%" PRIu64 ",\"host_time_us\":%" PRIu64, g_nr_guest_inst, us);
+  if (us > 0) fprintf(out, ",\"inst_per_sec\":%" PRIu64, g_nr_guest_inst * 1000000 / us);
+}
+
+static struct {
+  const char *name;
+  void (*handler) (char *);
+} script_table [] = {
+  { "si", script_si },
+  { "c", script_c },
+  { "info", script_info },
+  { "x", script_x },
+  { "p", script_p },
+  { "w", script_w },
+  { "d", script_d },
+#ifdef CONFIG_BREAKPOINT
+  { "b", script_b },
+  { "bd", script_bd },
+#endif
+#ifdef CONFIG_SNAPSHOT
+  { "save", script_save },
+  { "load", script_load },
+#endif
+  { "stat", script_stat },
+};
+
+#define NR_SCRIPT_CMD ARRLEN(script_table)
+
+void script_mainloop() {
+  FILE *fp = fopen(script_file, "r");
+  Assert(fp, "Can not open '%s'", script_file);
+
+  char *line = NULL;
+  size_t size = 0;
+  while (getline(&line, &size, fp) != -1) {
+    line[strcspn(line, "\r\n")] = '\0';
+
+    char *cmd = strtok(line, " ");
+    if (cmd == NULL || cmd[0] == '#') continue;
+    if (strcmp(cmd, "q") == 0) break;
+    char *args = strtok(NULL, "");
+
+    fprintf(out, "{\"cmd\":");
+    json_str(cmd);
+    if (args != NULL) {
+      fprintf(out, ",\"args\":");
+      json_str(args);
+    }
+
+    int i;
+    for (i = 0; i < NR_SCRIPT_CMD; i ++) {
+      if (strcmp(cmd, script_table[i].name) == 0) {
+        script_table[i].handler(args);
+        break;
+      }
+    }
+    if (i == NR_SCRIPT_CMD) json_error("unknown command");
+    fprintf(out, "}\n");
+    fflush(out);
+  }
+
+  free(line);
+  fclose(fp);
+  fclose(out);
+  if (nemu_state.state == NEMU_STOP || nemu_state.state == NEMU_RUNNING) cpu_quit();
+}
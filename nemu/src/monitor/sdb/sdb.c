@@ -20,15 +20,27 @@
 #include "sdb.h"
 #include "isa.h"
 #include <memory/vaddr.h>
+#include <memory/snapshot.h>
+#include <memory/checkpoint.h>
+#include <memory/mtrace.h>
+#include <cpu/reverse.h>
+#include <cpu/breakpoint.h>
 #include <stddef.h>
 
 
 static int is_batch_mode = false;
 
-void init_regex();
 void init_wp_pool();
 
 void info_w();
+void info_s();
+void info_b();
+int new_bp(vaddr_t pc, char *cond);
+bool free_bp(int n);
+bool sdb_is_gdb_mode();
+void gdb_mainloop();
+bool sdb_is_script_mode();
+void script_mainloop();
 
 /* We use the `readline' library to provide more flexibility to read from stdin. */
 static char* rl_gets() {
@@ -78,6 +90,18 @@ static int cmd_info(char *args) {
     isa_reg_display();
   } else if (*args == 'w') {
     info_w();
+#ifdef CONFIG_BREAKPOINT
+  } else if (*args == 'b') {
+    info_b();
+#endif
+#ifdef CONFIG_SNAPSHOT
+  } else if (*args == 's') {
+    info_s();
+#endif
+#ifdef CONFIG_HOST_PERF
+  } else if (*args == 'p') {
+    perf_dump();
+#endif
   } else {
     printf("Please input r or w !\n");
   }
@@ -115,10 +139,11 @@ static int cmd_p(char *args) {
 }
 
 static int cmd_w(char *args) {
-  bool success = true;
-  WP *tmp_wp = new_wp();
-  strcpy(tmp_wp->expr, args);
-  tmp_wp->in_val = expr(args, &success);
+  WP *tmp_wp = (args == NULL ? NULL : set_wp(args));
+  if (tmp_wp == NULL) {
+    puts("invalid expression");
+    return 0;
+  }
   printf("Watchpoint[%d] is set up on %s now.\n",tmp_wp->NO, tmp_wp->expr);
   return 0;
 }
@@ -134,6 +159,121 @@ static int cmd_d(char *args) {
   return 0;
 }
 
+#ifdef CONFIG_BREAKPOINT
+static int cmd_b(char *args) {
+  if (args == NULL) {
+    printf("Need the address of the breakpoint!\n");
+    return 0;
+  }
+
+  // b ADDR [if COND]
+  char *cond = strstr(args, " if ");
+  if (cond != NULL) {
+    *cond = '\0';
+    cond += 4;
+  }
+
+  bool success;
+  vaddr_t pc = expr(args, &success);
+  if (!success) {
+    puts("invalid expression");
+    return 0;
+  }
+  int n = new_bp(pc, cond);
+  if (n < 0) {
+    printf("Can not set up the breakpoint!\n");
+  } else {
+    printf("Breakpoint[%d] is set up at " FMT_WORD " now.\n", n, pc);
+  }
+  return 0;
+}
+
+static int cmd_bd(char *args) {
+  int n;
+  if (args == NULL || sscanf(args, "%d", &n) != 1) {
+    printf("Need the NO of the breakpoint!\n");
+  } else if (!free_bp(n)) {
+    printf("There is no breakpoint[%d]!\n", n);
+  }
+  return 0;
+}
+#endif
+
+#ifdef CONFIG_REVERSE
+static int cmd_rsi(char *args) {
+  char *arg = strtok(args, " ");
+  reverse_step(arg == NULL ? 1 : strtoull(arg, NULL, 0));
+  printf("Instruction %" PRIu64 ", pc = " FMT_WORD "\n", g_nr_guest_inst, cpu.pc);
+  return 0;
+}
+
+static int cmd_rc(char *args) {
+  reverse_continue();
+  printf("Instruction %" PRIu64 ", pc = " FMT_WORD "\n", g_nr_guest_inst, cpu.pc);
+  return 0;
+}
+#endif
+
+#ifdef CONFIG_SNAPSHOT
+static int cmd_save(char *args) {
+  int idx = snapshot_take(true);
+  if (idx < 0) {
+    printf("At most %d snapshots can be saved, load an older one to drop the newer ones!\n",
+        NR_USER_SNAPSHOT);
+    return 0;
+  }
+  printf("Snapshot[%d] is taken at instruction %" PRIu64 ".\n", idx, snapshot_nr_inst(idx));
+  return 0;
+}
+
+static int cmd_load(char *args) {
+  int idx = snapshot_count() - 1;
+  if (args != NULL) sscanf(args, "%d", &idx);
+  if (idx < 0 || idx >= snapshot_count()) {
+    printf("There is no snapshot[%d]!\n", idx);
+    return 0;
+  }
+  snapshot_restore(idx);
+  nemu_state.state = NEMU_STOP;
+  // do not stop at the breakpoint at the restored pc again
+  IFDEF(CONFIG_BREAKPOINT, bp_skip_pc = cpu.pc);
+  printf("Snapshot[%d] is restored, pc = " FMT_WORD ".\n", idx, cpu.pc);
+  return 0;
+}
+
+#ifdef CONFIG_CHECKPOINT
+static int cmd_ckpt(char *args) {
+  if (args == NULL) {
+    printf("Need the name of the checkpoint file!\n");
+  } else {
+    checkpoint_save(strtok(args, " "));
+  }
+  return 0;
+}
+#endif
+
+void info_s() {
+  int n = snapshot_count();
+  if (n == 0) {
+    printf("There are no snapshots!\n");
+    return;
+  }
+  for (int i = 0; i < n; i++) {
+    printf("Snapshot[%d] at instruction %" PRIu64 "\n", i, snapshot_nr_inst(i));
+  }
+}
+#endif
+
+#ifdef CONFIG_MTRACE
+static int cmd_mtrace(char *args) {
+  if (args == NULL) mtrace_info();
+  else if (strcmp(args, "on") == 0) mtrace_enable(true);
+  else if (strcmp(args, "off") == 0) mtrace_enable(false);
+  else mtrace_set_filter(args);
+  return 0;
+}
+#endif
+
 static struct {
   const char *name;
   const char *description;
@@ -145,11 +285,30 @@ static struct {
 
   /* TODO: Add more commands */
   { "si", "Let the program pause execution after stepping into an instruction", cmd_si },
-  { "info", "Print registers status(info r) or watchpoints info(info w)", cmd_info},
+  { "info", "Print registers status(info r), watchpoints info(info w), breakpoints info(info b), snapshots info(info s) or host performance counters(info perf)", cmd_info},
   { "x", "Print address memory", cmd_x},
   { "p", "Find the value of the expression", cmd_p},
   { "w", "Set up a new watchpoint", cmd_w},
   { "d", "Free the Watchpoint", cmd_d},
+#ifdef CONFIG_BREAKPOINT
+  { "b", "Set up a breakpoint at ADDR, stop only if COND holds: b ADDR [if COND]", cmd_b},
+  { "bd", "Free the Breakpoint", cmd_bd},
+#endif
+#ifdef CONFIG_REVERSE
+  { "rsi", "Step back N instructions, 1 by default", cmd_rsi},
+  { "rc", "Continue backwards to the latest breakpoint or watchpoint", cmd_rc},
+#endif
+#ifdef CONFIG_SNAPSHOT
+  { "save", "Take a snapshot of the machine", cmd_save},
+  { "load", "Restore snapshot N (the latest by default) and drop the newer ones", cmd_load},
+#endif
+#ifdef CONFIG_CHECKPOINT
+  { "ckpt", "Save the machine state to a checkpoint file", cmd_ckpt},
+#endif
+#ifdef CONFIG_MTRACE
+  { "mtrace", "Show the memory trace, turn it on/off, or filter it: "
+    "mtrace [on|off|addr=LO:HI|pc=LO:HI|pc=FUNC|type=rwx ...]", cmd_mtrace},
+#endif
 };
 
 #define NR_CMD ARRLEN(cmd_table)
@@ -182,6 +341,18 @@ void sdb_set_batch_mode() {
 }
 
 void sdb_mainloop() {
+#ifdef CONFIG_GDBSTUB
+  if (sdb_is_gdb_mode()) {
+    gdb_mainloop();
+    return;
+  }
+#endif
+
+  if (sdb_is_script_mode()) {
+    script_mainloop();
+    return;
+  }
+
   if (is_batch_mode) {
     cmd_c(NULL);
     return;
@@ -220,9 +391,6 @@ void sdb_mainloop() {
 }
 
 void init_sdb() {
-  /* Compile the regular expressions. */
-  init_regex();
-
   /* Initialize the watchpoint pool. */
   init_wp_pool();
 }
@@ -20,6 +20,26 @@
 
 word_t expr(char *e, bool *success);
 
+// an operation of the compiled expression, see expr_compile()
+typedef struct {
+  int op;
+  word_t imm;
+  const word_t *reg;
+} ExprOp;
+
+#define NR_EXPR_OP 64 // after constant folding
+
+// the state read by a compiled expression
+typedef struct {
+  uint64_t reg_mask; // general purpose registers
+  paddr_t mem[NR_EXPR_OP]; // 4-byte words in pmem
+  int nr_mem;
+  bool poll; // can not be determined before running
+} ExprDeps;
+
+int expr_compile(char *e, ExprOp *buf, ExprDeps *deps);
+word_t expr_run(const ExprOp *buf, int n, bool *success);
+
 typedef struct watchpoint {
   int NO;
   struct watchpoint *next;
@@ -27,11 +47,19 @@ typedef struct watchpoint {
   /* TODO: Add more members if necessary */
   char expr[64];    // store expr
   uint32_t in_val;  // expr value
+  ExprOp code[NR_EXPR_OP];
+  int nr_code;
+  ExprDeps deps;
 
 } WP;
 
 WP* new_wp();
 WP* get_wp(int n);
 void free_wp(int n);
+void wp_update();
+WP* set_wp(char *e);
+
+extern int wp_last_hit;
+extern int bp_last_hit;
 
 #endif
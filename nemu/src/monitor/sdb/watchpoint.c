@@ -14,12 +14,20 @@
 ***************************************************************************************/
 
 #include "sdb.h"
+#include <cpu/cpu.h>
+#include <cpu/watchpoint.h>
 
 #define NR_WP 32
 
 static WP wp_pool[NR_WP] = {};
 static WP *head = NULL, *free_ = NULL;
 
+bool wp_triggered = false;
+bool wp_poll = false;
+uint64_t wp_reg_mask = 0;
+uint16_t wp_page[WP_NR_PAGE] = {};
+int wp_last_hit = -1; // NO of the latest changed watchpoint
+
 void init_wp_pool() {
   int i;
   for (i = 0; i < NR_WP; i ++) {
@@ -84,24 +92,94 @@ void free_wp(int n) {
   wp->next = free_;
   free_ = wp;
   wp->in_val = 0;
+  wp->nr_code = 0;
   memset(wp->expr, '\0', 64);
+  wp_update();
+}
+
+/* Set up a new watchpoint on the expression `e`. Return NULL if `e` is
+ * invalid or there is no free watchpoint.
+ */
+WP* set_wp(char *e) {
+  ExprOp code[NR_EXPR_OP];
+  bool success;
+  ExprDeps deps;
+  int nr_code = expr_compile(e, code, &deps);
+  if (nr_code < 0 || free_ == NULL) return NULL;
+
+  WP *wp = new_wp();
+  strncpy(wp->expr, e, sizeof(wp->expr) - 1);
+  memcpy(wp->code, code, sizeof(code[0]) * nr_code);
+  wp->nr_code = nr_code;
+  wp->in_val = expr_run(code, nr_code, &success);
+  wp->deps = deps;
+  wp_update();
+  return wp;
+}
+
+static inline uint32_t page_of(paddr_t addr) {
+  return (addr - CONFIG_MBASE) >> PAGE_SHIFT;
+}
+
+/* Collect the state read by all watchpoints. Called after a watchpoint
+ * is set up or freed.
+ */
+void wp_update() {
+  WP *wp;
+  int i;
+
+  memset(wp_page, 0, sizeof(wp_page));
+  wp_reg_mask = 0;
+  wp_poll = false;
+  for (wp = head; wp != NULL; wp = wp->next) {
+    wp_reg_mask |= wp->deps.reg_mask;
+    wp_poll |= wp->deps.poll;
+    for (i = 0; i < wp->deps.nr_mem; i ++) {
+      wp_page[page_of(wp->deps.mem[i])] ++;
+      wp_page[page_of(wp->deps.mem[i] + 3)] ++;
+    }
+  }
+}
+
+// a store hits a page with watched words, check the exact range
+void wp_check_write(paddr_t addr, int len) {
+  WP *wp;
+  int i;
+
+  for (wp = head; wp != NULL; wp = wp->next) {
+    for (i = 0; i < wp->deps.nr_mem; i ++) {
+      paddr_t m = wp->deps.mem[i];
+      if (addr < m + 4 && m < addr + len) {
+        wp_triggered = true;
+        return;
+      }
+    }
+  }
+}
+
+// evaluate the watchpoints again after the state is restored
+void wp_sync() {
+  WP *wp;
+  bool success;
+  for (wp = head; wp != NULL; wp = wp->next) {
+    wp->in_val = expr_run(wp->code, wp->nr_code, &success);
+  }
+  wp_triggered = false;
 }
 
 bool check_watchpoints() {
   WP *tmp = head;
-	bool success = true;
-	bool changed = false;
+  bool success;
+  bool changed = false;
   word_t tmp_val;
-  if (tmp == NULL) {
-    printf("Watchpoint is NULL!\n");
-  }
-		
+
+  wp_triggered = false;
   while(tmp != NULL) {
-    printf("Watchpoint[%d].expr = %s\n",tmp->NO,tmp->expr);
-    tmp_val = expr(tmp->expr, &success);
+    tmp_val = expr_run(tmp->code, tmp->nr_code, &success);
     if (tmp->in_val != tmp_val) {
       changed = true;
-      printf("watchpoint %d has changed, from 0x%x to 0x%x\n", tmp->NO, tmp->in_val, tmp_val);
+      wp_last_hit = tmp->NO;
+      if (g_debug_mode == DEBUG_STOP) printf("watchpoint %d has changed, from 0x%x to 0x%x\n", tmp->NO, tmp->in_val, tmp_val);
       tmp->in_val = tmp_val;
     }
     tmp = tmp->next;
@@ -13,6 +13,14 @@
 # See the Mulan PSL v2 for more details.
 #**************************************************************************************/
 
+ifndef CONFIG_REPLAY
+SRCS-BLACKLIST-y += src/utils/replay.c
+endif
+
+ifndef CONFIG_HOST_PERF
+SRCS-BLACKLIST-y += src/utils/perf.c
+endif
+
 ifneq ($(CONFIG_ITRACE)$(CONFIG_IQUEUE),)
 CXXSRC = src/utils/disasm.cc
 CXXFLAGS += $(shell llvm-config --cxxflags) -fPIE
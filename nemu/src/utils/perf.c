@@ -0,0 +1,137 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <common.h>
+#include <time.h>
+
+extern uint64_t g_nr_guest_inst;
+
+struct PerfFrame perf_stack[PERF_MAX_DEPTH] = {};
+int perf_depth = 0;
+bool perf_sampled = false;
+uint64_t perf_seed = 1;
+uint64_t perf_count[NR_PERF] = {}; // the calls in PERF_RUN
+
+// the exclusive ticks of the timed calls in PERF_RUN, and their number
+static uint64_t ticks[NR_PERF] = {}, nr_timed[NR_PERF] = {};
+// the inclusive ticks and the calls of the phases not in any other phase
+static uint64_t top_ticks[NR_PERF] = {}, top_count[NR_PERF] = {};
+// the ticks of the clock reads in a timed call, as seen by itself and by its parent
+static uint64_t self_overhead = 0, parent_overhead = 0;
+static uint64_t start_ticks = 0, start_ns = 0;
+
+uint64_t perf_clock_ns() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+void perf_end_timed(struct PerfFrame *f, uint64_t now) {
+  uint64_t t = now - f->start;
+  int d = f - perf_stack;
+  if (d == 0) {
+    top_ticks[f->phase] += t;
+    top_count[f->phase] ++;
+    return;
+  }
+  uint64_t self = t - f->child;
+  ticks[f->phase] += (self > self_overhead ? self - self_overhead : 0);
+  nr_timed[f->phase] ++;
+  perf_stack[d - 1].child += t + parent_overhead;
+}
+
+#define NR_CALIBRATE 5000
+
+static int cmp_u64(const void *a, const void *b) {
+  uint64_t x = *(uint64_t *)a, y = *(uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+/* Time empty calls, and empty calls with an empty call nested, with the
+ * real code, and take the medians as the overheads, since the host may
+ * interrupt any of them.
+ */
+static void calibrate() {
+  static uint64_t empty[NR_CALIBRATE], nested[NR_CALIBRATE];
+  int i;
+
+  // time the calls in a sampled call, whose child is the time of them
+  // with the parent overhead
+  perf_depth = 2;
+  perf_sampled = true;
+  perf_stack[1] = (struct PerfFrame){ .phase = PERF_EXEC };
+  for (i = 0; i < NR_CALIBRATE * 2; i ++) {
+    perf_stack[1].child = 0;
+    perf_begin(PERF_DECODE);
+    if (i % 2 == 1) { perf_begin(PERF_PADDR); perf_end(); }
+    perf_end();
+    if (i % 2 == 0) empty[i / 2] = perf_stack[1].child;
+    else nested[i / 2] = perf_stack[1].child;
+  }
+  perf_depth = 0;
+
+  qsort(empty, NR_CALIBRATE, sizeof(empty[0]), cmp_u64);
+  qsort(nested, NR_CALIBRATE, sizeof(nested[0]), cmp_u64);
+  uint64_t call = empty[NR_CALIBRATE / 2], call_with_child = nested[NR_CALIBRATE / 2];
+  self_overhead = call;
+  parent_overhead = (call_with_child > 2 * call ? call_with_child - 2 * call : 0);
+  memset(ticks, 0, sizeof(ticks));
+  memset(nr_timed, 0, sizeof(nr_timed));
+  memset(perf_count, 0, sizeof(perf_count));
+}
+
+void init_perf() {
+  calibrate();
+  start_ticks = perf_now();
+  start_ns = perf_clock_ns();
+}
+
+// scale the ticks of the timed calls to all calls
+static double estimate(int phase) {
+  return (nr_timed[phase] == 0 ? 0 : (double)ticks[phase] * perf_count[phase] / nr_timed[phase]);
+}
+
+void perf_dump() {
+  static const char *name[NR_PERF] = {
+    [PERF_RUN] = "main loop", [PERF_EXEC] = "execute", [PERF_DECODE] = "decode",
+    [PERF_PADDR] = "pmem", [PERF_MMIO] = "mmio", [PERF_DEVICE] = "device",
+    [PERF_TRACE] = "trace", [PERF_DIFFTEST] = "difftest", [PERF_LOG] = "log",
+  };
+  double t[NR_PERF], total = 0, nested = 0;
+  uint64_t ticks_now = perf_now(), ns_now = perf_clock_ns();
+  double scale = (ticks_now == start_ticks ? 0 : (double)(ns_now - start_ns) / (ticks_now - start_ticks));
+  int i;
+
+  for (i = 0; i < NR_PERF; i ++) {
+    t[i] = estimate(i) + (i == PERF_RUN ? 0 : top_ticks[i]);
+    nested += estimate(i);
+  }
+  // what is left in PERF_RUN is the main loop itself
+  t[PERF_RUN] = top_ticks[PERF_RUN] > nested ? top_ticks[PERF_RUN] - nested : 0;
+  for (i = 0; i < NR_PERF; i ++) total += t[i];
+
+  Log("host time by phase: %.3f ms in total, %.2f ns per guest instruction, "
+      "1 in %d calls timed", total * scale / 1e6,
+      (g_nr_guest_inst == 0 ? 0 : total * scale / g_nr_guest_inst), CONFIG_HOST_PERF_SAMPLE);
+  _Log("  %-10s %16s %12s %10s %8s\n", "phase", "calls", "time(ms)", "ns/call", "%");
+  for (i = 0; i < NR_PERF; i ++) {
+    // the main loop is counted by iterations
+    uint64_t calls = (i == PERF_RUN ? g_nr_guest_inst : perf_count[i] + top_count[i]);
+    if (calls == 0) continue;
+    _Log("  %-10s %16" PRIu64 " %12.3f %10.2f %8.2f\n", name[i], calls, t[i] * scale / 1e6,
+        t[i] * scale / calls, (total == 0 ? 0 : 100.0 * t[i] / total));
+  }
+}
@@ -14,10 +14,15 @@
 ***************************************************************************************/
 
 #include <common.h>
+#include <utils.h>
 #ifndef CONFIG_TARGET_AM
 #include <time.h>
+
+static uint64_t host_seed() {
+  return time(0);
+}
 #endif
 
 void init_rand() {
-  srand(MUXDEF(CONFIG_TARGET_AM, 0, time(0)));
+  srand(MUXDEF(CONFIG_TARGET_AM, 0, MUXDEF(CONFIG_REPLAY, input_log(INPUT_SEED, host_seed), host_seed())));
 }
@@ -0,0 +1,139 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <common.h>
+#include <utils.h>
+#include <cpu/reverse.h>
+
+/* Every value from the host which is visible to the guest goes through
+ * input_log(). With `--record=FILE`, the values are written to FILE with the
+ * instruction counts when they are delivered. With `--replay=FILE`, they are
+ * read back and delivered at exactly the same instructions, so the run is
+ * reproduced bit by bit.
+ *
+ * An entry in the file is the difference of the instruction count from the
+ * previous entry, the type, and the value, where the numbers are encoded as
+ * LEB128, i.e. 7 bits per byte with the highest bit set if more follow.
+ */
+
+#define REPLAY_MAGIC "NEMUREC1"
+
+extern uint64_t g_nr_guest_inst;
+
+static FILE *record_fp = NULL;
+static FILE *replay_fp = NULL;
+static uint64_t record_last = 0, replay_last = 0;
+
+static struct {
+  bool valid;
+  uint64_t nr_inst;
+  int type;
+  uint64_t val;
+} next = {};
+
+static const char *type_name[] = {
+  [INPUT_SEED] = "seed", [INPUT_RTC] = "rtc", [INPUT_KEY] = "key",
+};
+
+static void put_uleb(uint64_t x) {
+  do {
+    uint8_t byte = x & 0x7f;
+    x >>= 7;
+    fputc(byte | (x != 0 ? 0x80 : 0), record_fp);
+  } while (x != 0);
+}
+
+static bool get_uleb(uint64_t *x) {
+  int c, shift = 0;
+  *x = 0;
+  do {
+    if ((c = fgetc(replay_fp)) == EOF) return false;
+    *x |= (uint64_t)(c & 0x7f) << shift;
+    shift += 7;
+  } while (c & 0x80);
+  return true;
+}
+
+static void read_next() {
+  uint64_t delta, type;
+  next.valid = get_uleb(&delta) && get_uleb(&type) && get_uleb(&next.val);
+  if (!next.valid) {
+    Log("Replay: the end of the log is reached at instruction %" PRIu64
+        ", use the inputs from the host from now on", g_nr_guest_inst);
+    fclose(replay_fp);
+    replay_fp = NULL;
+    return;
+  }
+  next.nr_inst = replay_last += delta;
+  next.type = type;
+}
+
+static bool replay(int type, uint64_t *val) {
+  // skip the inputs before the current instruction, e.g. after restoring a checkpoint
+  while (next.valid && next.nr_inst < g_nr_guest_inst) read_next();
+  if (!next.valid) return false;
+
+  Assert(next.nr_inst == g_nr_guest_inst && next.type == type,
+      "Replay: the execution diverges at instruction %" PRIu64 ", "
+      "expect input '%s' at instruction %" PRIu64 ", but get input '%s'",
+      g_nr_guest_inst, type_name[next.type], next.nr_inst, type_name[type]);
+  *val = next.val;
+  read_next();
+  return true;
+}
+
+uint64_t input_log(int type, uint64_t (*host_input)()) {
+  uint64_t val;
+  // replaying the history of reverse execution
+  IFDEF(CONFIG_REVERSE, if (reverse_replay_input(&val)) return val);
+
+  // ask the host only without a replayed value, since reading a key consumes it
+  if (!(next.valid && replay(type, &val))) val = host_input();
+  if (record_fp != NULL) {
+    put_uleb(g_nr_guest_inst - record_last);
+    put_uleb(type);
+    put_uleb(val);
+    record_last = g_nr_guest_inst;
+  }
+
+  IFDEF(CONFIG_REVERSE, reverse_log_input(val));
+  return val;
+}
+
+static void close_record() {
+  fclose(record_fp);
+}
+
+void init_replay(const char *record_file, const char *replay_file) {
+  char magic[sizeof(REPLAY_MAGIC) - 1];
+
+  if (replay_file != NULL) {
+    replay_fp = fopen(replay_file, "rb");
+    Assert(replay_fp, "Can not open '%s'", replay_file);
+    Assert(fread(magic, sizeof(magic), 1, replay_fp) == 1 &&
+        memcmp(magic, REPLAY_MAGIC, sizeof(magic)) == 0, "'%s' is not an input log", replay_file);
+    read_next();
+    Log("Replay the inputs from %s", replay_file);
+  }
+
+  if (record_file != NULL) {
+    record_fp = fopen(record_file, "wb");
+    Assert(record_fp, "Can not open '%s'", record_file);
+    fwrite(REPLAY_MAGIC, sizeof(magic), 1, record_fp);
+    atexit(close_record);
+    Log("Record the inputs to %s", record_file);
+  }
+}
@@ -0,0 +1,100 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <am.h>
+#include <klib.h>
+#include <klib-macros.h>
+
+/* Branchy code: a quicksort of random keys, a binary search and a small
+ * bytecode interpreter dispatching through a switch.
+ */
+
+#define ROUNDS 8
+#define N 16384
+#define EXPECTED 0x20a3a3d4u
+
+static uint32_t keys[N];
+static uint32_t seed = 1;
+
+static uint32_t next() {
+  seed = seed * 1664525u + 1013904223u;
+  return seed >> 8;
+}
+
+static void qsort_keys(uint32_t *a, int lo, int hi) {
+  while (lo < hi) {
+    uint32_t pivot = a[(lo + hi) / 2];
+    int i = lo, j = hi;
+    while (i <= j) {
+      while (a[i] < pivot) i ++;
+      while (a[j] > pivot) j --;
+      if (i <= j) {
+        uint32_t t = a[i]; a[i] = a[j]; a[j] = t;
+        i ++; j --;
+      }
+    }
+    // recurse into the smaller part
+    if (j - lo < hi - i) { qsort_keys(a, lo, j); lo = i; }
+    else { qsort_keys(a, i, hi); hi = j; }
+  }
+}
+
+static int search(const uint32_t *a, int n, uint32_t key) {
+  int lo = 0, hi = n - 1;
+  while (lo <= hi) {
+    int mid = (lo + hi) / 2;
+    if (a[mid] == key) return mid;
+    if (a[mid] < key) lo = mid + 1;
+    else hi = mid - 1;
+  }
+  return -1;
+}
+
+enum { OP_ADD, OP_XOR, OP_SHL, OP_JNZ, OP_DEC, OP_HALT };
+
+static uint32_t interp(uint32_t acc) {
+  static const uint8_t code[] = {
+    OP_ADD, OP_XOR, OP_SHL, OP_DEC, OP_JNZ, OP_ADD, OP_HALT,
+  };
+  uint32_t cnt = 2000;
+  int pc = 0;
+  while (1) {
+    switch (code[pc ++]) {
+      case OP_ADD: acc += cnt; break;
+      case OP_XOR: acc ^= acc >> 3; break;
+      case OP_SHL: acc = (acc << 1) | (acc >> 31); break;
+      case OP_DEC: cnt --; break;
+      case OP_JNZ: if (cnt != 0) pc = 0; break;
+      default: return acc;
+    }
+  }
+}
+
+int main(const char *args) {
+  uint32_t sum = 0;
+  int r, i;
+
+  for (r = 0; r < ROUNDS; r ++) {
+    for (i = 0; i < N; i ++) keys[i] = next();
+    qsort_keys(keys, 0, N - 1);
+    for (i = 0; i < N; i ++) sum += search(keys, N, (i & 1 ? keys[i] : next()));
+    sum = interp(sum);
+  }
+
+  printf("branch: checksum = 0x%08x\n", sum);
+  panic_on(sum != EXPECTED, "wrong checksum");
+  return 0;
+}
@@ -0,0 +1,49 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <am.h>
+#include <klib.h>
+#include <klib-macros.h>
+
+/* MMIO-heavy framebuffer writes: every frame is drawn tile by tile through
+ * the GPU device, then synchronized.
+ */
+
+#define FRAMES 30
+#define TILE 16
+
+static uint32_t tile[TILE * TILE];
+
+int main(const char *args) {
+  ioe_init();
+  AM_GPU_CONFIG_T cfg = io_read(AM_GPU_CONFIG);
+  panic_on(!cfg.present, "no GPU");
+
+  int f, x, y, i;
+  for (f = 0; f < FRAMES; f ++) {
+    for (y = 0; y + TILE <= cfg.height; y += TILE) {
+      for (x = 0; x + TILE <= cfg.width; x += TILE) {
+        uint32_t color = (x * 4) << 16 | (y * 4) << 8 | (f * 8);
+        for (i = 0; i < TILE * TILE; i ++) tile[i] = color + i;
+        io_write(AM_GPU_FBDRAW, x, y, tile, TILE, TILE, false);
+      }
+    }
+    io_write(AM_GPU_FBDRAW, 0, 0, NULL, 0, 0, true);
+  }
+
+  printf("fbwrite: %d frames of %dx%d\n", FRAMES, cfg.width, cfg.height);
+  return 0;
+}
@@ -0,0 +1,81 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <am.h>
+#include <klib.h>
+#include <klib-macros.h>
+
+/* CPU-bound integer kernels: a sieve, CRC32 and a multiply/divide mix.
+ * The checksum guards against a broken engine looking fast.
+ */
+
+#define ROUNDS 20
+#define SIEVE_N 65536
+#define CRC_LEN 16384
+#define EXPECTED 0xe22f193fu
+
+static uint8_t composite[SIEVE_N];
+static uint8_t buf[CRC_LEN];
+static uint32_t crc_table[256];
+
+static uint32_t sieve() {
+  uint32_t i, j, n = 0;
+  for (i = 0; i < SIEVE_N; i ++) composite[i] = 0;
+  for (i = 2; i < SIEVE_N; i ++) {
+    if (composite[i]) continue;
+    n ++;
+    for (j = i + i; j < SIEVE_N; j += i) composite[j] = 1;
+  }
+  return n;
+}
+
+static uint32_t crc32(const uint8_t *p, uint32_t len) {
+  uint32_t crc = 0xffffffffu;
+  while (len --) crc = crc_table[(crc ^ *p ++) & 0xff] ^ (crc >> 8);
+  return ~crc;
+}
+
+static uint32_t muldiv(uint32_t seed) {
+  uint32_t x = seed | 1, acc = 0, i;
+  for (i = 0; i < 4096; i ++) {
+    x = x * 1103515245u + 12345u;
+    acc += (x >> 7) / ((i & 0xff) + 1);
+    acc ^= (x % 1009u) * (acc | 3);
+  }
+  return acc;
+}
+
+int main(const char *args) {
+  uint32_t i, j, sum = 0;
+
+  for (i = 0; i < 256; i ++) {
+    uint32_t c = i;
+    for (j = 0; j < 8; j ++) c = (c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1);
+    crc_table[i] = c;
+  }
+  for (i = 0; i < CRC_LEN; i ++) buf[i] = i * 7 + (i >> 5);
+
+  for (i = 0; i < ROUNDS; i ++) {
+    sum += sieve();
+    buf[i] ^= sum;
+    sum ^= crc32(buf, CRC_LEN);
+    sum += muldiv(sum);
+  }
+
+  printf("intcpu: checksum = 0x%08x\n", sum);
+  panic_on(sum != EXPECTED, "wrong checksum");
+  return 0;
+}
@@ -0,0 +1,59 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <am.h>
+#include <klib.h>
+#include <klib-macros.h>
+
+/* Memory-bound copies: word, byte and overlapping copies over buffers
+ * larger than a typical host L1 cache.
+ */
+
+#define ROUNDS 100
+#define WORDS (64 * 1024)
+#define EXPECTED 0xa166f048u
+
+static uint32_t src[WORDS], dst[WORDS];
+
+static void copy_word(uint32_t *d, const uint32_t *s, uint32_t n) {
+  while (n --) *d ++ = *s ++;
+}
+
+static void copy_byte(uint8_t *d, const uint8_t *s, uint32_t n) {
+  while (n --) *d ++ = *s ++;
+}
+
+static void fill(uint32_t *d, uint32_t val, uint32_t n) {
+  while (n --) *d ++ = val ++;
+}
+
+int main(const char *args) {
+  uint32_t i, sum = 0;
+
+  fill(src, 0x12345678u, WORDS);
+  for (i = 0; i < ROUNDS; i ++) {
+    copy_word(dst, src, WORDS);
+    // a misaligned byte copy, then a copy of the second half onto the first
+    copy_byte((uint8_t *)dst + 1, (uint8_t *)src + 3, WORDS);
+    copy_word(dst, dst + WORDS / 2, WORDS / 2);
+    sum = sum * 31 + dst[i * 997 % WORDS] + dst[WORDS - 1 - i];
+    src[i] ^= sum;
+  }
+
+  printf("memcpy: checksum = 0x%08x\n", sum);
+  panic_on(sum != EXPECTED, "wrong checksum");
+  return 0;
+}
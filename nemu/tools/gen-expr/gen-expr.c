@@ -37,29 +37,21 @@ static int choose(unsigned int i) {
 }
 
 static void gen_num() {
-  int i = choose(65536);
-  sprintf(buf + count, "%d", i);
-  while(buf[count]) {
-    count++;
+  // unsigned literals, so that the host evaluates it as NEMU does
+  switch (choose(4)) {
+    case 0: count += sprintf(buf + count, "0x%xu", choose(65536)); break;
+    case 1: count += sprintf(buf + count, "%du", choose(32)); break;
+    default: count += sprintf(buf + count, "%du", choose(65536)); break;
   }
 }
 
+static const char *ops[] = {
+  "+", "-", "*", "/", "%", "<<", ">>", "<", ">", "<=", ">=",
+  "==", "!=", "&", "^", "|", "&&", "||",
+};
+
 static void gen_rand_op() {
-  switch(choose(4)) {
-    case 0:
-      sprintf(buf+count, "%c", '+');
-      break;
-    case 1: 
-      sprintf(buf+count, "%c", '-');
-      break;
-    case 2:
-      sprintf(buf+count, "%c", '*');
-      break;
-    case 3:
-      sprintf(buf+count, "%c", '/');
-      break;
-  }
-  count++;
+  count += sprintf(buf + count, "%s", ops[choose(sizeof(ops) / sizeof(ops[0]))]);
 }
 
 static void gen(char c) {
@@ -67,15 +59,24 @@ static void gen(char c) {
   count++;
 }
 
+static void gen_space() {
+  if (choose(4) == 0) gen(' ');
+}
+
 static void gen_rand_expr() {
-  // buf[0] = '\0';
-  int i = choose(3);
-  if(count > 20) { i = 0; }
+  int i = choose(6);
+  if(count > 100) { i = 0; }
+  gen_space();
   switch (i) {
     case 0: gen_num(); break;
     case 1: gen('('); gen_rand_expr(); gen(')'); break;
+    case 2: gen("-!~"[choose(3)]); gen('('); gen_rand_expr(); gen(')'); break;
+    case 3:
+      gen('('); gen_rand_expr(); gen('?'); gen_rand_expr(); gen(':'); gen_rand_expr(); gen(')');
+      break;
     default: gen_rand_expr(); gen_rand_op(); gen_rand_expr(); break;
   }
+  gen_space();
 }
 
 int main(int argc, char *argv[]) {
@@ -87,6 +88,7 @@ int main(int argc, char *argv[]) {
   }
   int i;
   for (i = 0; i < loop; i ++) {
+    count = 0;
     gen_rand_expr();
 
     sprintf(code_buf, code_format, buf);
@@ -96,14 +98,15 @@ int main(int argc, char *argv[]) {
     fputs(code_buf, fp);
     fclose(fp);
 
-    int ret = system("gcc /tmp/.code.c -o /tmp/.expr");
+    // skip the expressions with division by zero or oversized shifts
+    int ret = system("gcc -Werror /tmp/.code.c -o /tmp/.expr 2>/dev/null");
     if (ret != 0) continue;
 
     fp = popen("/tmp/.expr", "r");
     assert(fp != NULL);
 
-    int result;
-    fscanf(fp, "%d", &result);
+    unsigned result;
+    fscanf(fp, "%u", &result);
     pclose(fp);
 
     printf("%u %s\n", result, buf);
@@ -20,6 +20,8 @@
 
 #include <fcntl.h>
 #include <errno.h>
+#include <signal.h>
+#include <sys/time.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <linux/kvm.h>
@@ -59,11 +61,10 @@ enum {
 static struct vm vm;
 static struct vcpu vcpu;
 
-// This should be called everytime after KVM_SET_REGS.
-// It seems that KVM_SET_REGS will clean the state of single step.
-static void kvm_set_step_mode(bool watch, uint32_t watch_addr) {
+static void kvm_set_guest_debug(bool step, bool watch, uint32_t watch_addr) {
   struct kvm_guest_debug debug = {};
-  debug.control = KVM_GUESTDBG_ENABLE | KVM_GUESTDBG_SINGLESTEP | KVM_GUESTDBG_USE_HW_BP;
+  debug.control = KVM_GUESTDBG_ENABLE | KVM_GUESTDBG_USE_HW_BP |
+    (step ? KVM_GUESTDBG_SINGLESTEP : 0);
   debug.arch.debugreg[0] = watch_addr;
   debug.arch.debugreg[7] = (watch ? 0x1 : 0x0); // watch instruction fetch at `watch_addr`
   if (ioctl(vcpu.fd, KVM_SET_GUEST_DEBUG, &debug) < 0) {
@@ -72,6 +73,12 @@ static void kvm_set_step_mode(bool watch, uint32_t watch_addr) {
   }
 }
 
+// This should be called everytime after KVM_SET_REGS.
+// It seems that KVM_SET_REGS will clean the state of single step.
+static void kvm_set_step_mode(bool watch, uint32_t watch_addr) {
+  kvm_set_guest_debug(true, watch, watch_addr);
+}
+
 static void kvm_setregs(const struct kvm_regs *r) {
   if (ioctl(vcpu.fd, KVM_SET_REGS, r) < 0) {
     perror("KVM_SET_REGS");
@@ -285,13 +292,38 @@ static void patching_after(uint64_t last_pc) {
   }
 }
 
+// the translation of the latest page checked by need_patching(), which
+// is valid until the vcpu runs or its memory is written
+static uint64_t patch_vpn = -1ull, patch_ppn = 0;
+
+// Whether the instruction at `pc` is fixed by patching() or patching_after(),
+// so that it has to be run by kvm_exec() instead of kvm_exec_until().
+static bool need_patching(uint64_t pc) {
+  if ((pc >> 12) != patch_vpn) {
+    uint64_t pa = va2pa(pc & ~0xfffull);
+    if (pa == -1ull) return false;
+    patch_vpn = pc >> 12;
+    patch_ppn = pa >> 12;
+  }
+  uint64_t pa = (patch_ppn << 12) | (pc & 0xfff);
+  if (pa + 1 >= CONFIG_MSIZE) return false;
+  switch (vm.mem[pa]) {
+    case 0x9c: case 0x9d: case 0xcf: // pushf, popf, iret
+    case 0x06: case 0x1e: return true; // push %es/%ds
+    case 0x0f: return vm.mem[pa + 1] == 0xa0; // push %fs
+    default: return false;
+  }
+}
+
 static void kvm_exec(uint64_t n) {
+  patch_vpn = -1ull;
   for (; n > 0; n --) {
     if (patching()) continue;
 
     uint64_t pc = vcpu.kvm_run->s.regs.regs.rip;
     if (ioctl(vcpu.fd, KVM_RUN, 0) < 0) {
       if (errno == EINTR) {
+        if (vcpu.kvm_run->immediate_exit) return; // out of time in kvm_exec_until()
         n ++;
         continue;
       }
@@ -327,6 +359,70 @@ static void kvm_exec(uint64_t n) {
   }
 }
 
+// the vcpu must reach the sync point of a batch within this time
+#define EXEC_UNTIL_TIMEOUT_S 1
+
+static void exec_until_timeout(int sig) {
+  // make the running or the next KVM_RUN return with EINTR
+  vcpu.kvm_run->immediate_exit = 1;
+}
+
+// Let the vcpu run freely until the instruction at `pc` is about to be
+// executed for the `nr_hit`-th time, not counting the current one. The only
+// debug exit is the hardware breakpoint at `pc`, and registers are exchanged
+// through the shared `kvm_run` area (KVM_SYNC_X86_REGS), so no extra ioctl
+// is issued per instruction. Return false if the vcpu stops for any other reason, or
+// does not get there within EXEC_UNTIL_TIMEOUT_S; the caller should then
+// resynchronize and fall back to single-step mode.
+static bool kvm_exec_until(uint32_t pc, uint64_t nr_hit) {
+  if (vcpu.int_wp_state != STATE_IDLE) return false;
+  patch_vpn = -1ull;
+
+  // no SA_RESTART, so that KVM_RUN is interrupted
+  struct sigaction sa = { .sa_handler = exec_until_timeout }, old_sa;
+  struct itimerval it = { .it_value.tv_sec = EXEC_UNTIL_TIMEOUT_S }, stop = {};
+  int ret = sigaction(SIGALRM, &sa, &old_sa);
+  assert(ret == 0);
+  ret = setitimer(ITIMER_REAL, &it, NULL);
+  assert(ret == 0);
+
+  struct kvm_regs *r = &vcpu.kvm_run->s.regs.regs;
+  bool ok = false;
+  while (true) {
+    // KVM does not let RF suppress its own breakpoint, so the instruction
+    // at `pc` is stepped over with the breakpoint removed
+    if (r->rip == pc) {
+      kvm_exec(1);
+      if (vcpu.kvm_run->immediate_exit || vcpu.int_wp_state != STATE_IDLE) break;
+    }
+    r->rflags &= ~RFLAGS_TF;
+    vcpu.kvm_run->kvm_dirty_regs = KVM_SYNC_X86_REGS;
+    kvm_set_guest_debug(false, true, pc);
+
+    if (ioctl(vcpu.fd, KVM_RUN, 0) < 0) {
+      if (errno == EINTR && !vcpu.kvm_run->immediate_exit) continue;
+      if (errno == EINTR) break; // out of time
+      perror("KVM_RUN");
+      assert(0);
+    }
+
+    if (vcpu.kvm_run->exit_reason != KVM_EXIT_DEBUG ||
+        vcpu.kvm_run->debug.arch.pc != pc) break;
+    if (-- nr_hit == 0) { ok = true; break; }
+    kvm_set_step_mode(false, 0);
+  }
+
+  setitimer(ITIMER_REAL, &stop, NULL);
+  sigaction(SIGALRM, &old_sa, NULL);
+  vcpu.kvm_run->immediate_exit = 0;
+
+  // restore single-step mode
+  r->rflags |= RFLAGS_TF;
+  vcpu.kvm_run->kvm_dirty_regs = KVM_SYNC_X86_REGS;
+  kvm_set_step_mode(false, 0);
+  return ok;
+}
+
 static void run_protected_mode() {
   struct kvm_sregs sregs;
   kvm_getsregs(&sregs);
@@ -346,8 +442,10 @@ static void run_protected_mode() {
 }
 
 __EXPORT void difftest_memcpy(paddr_t addr, void *buf, size_t n, bool direction) {
-  if (direction == DIFFTEST_TO_REF) memcpy(vm.mem + addr, buf, n);
-  else memcpy(buf, vm.mem + addr, n);
+  if (direction == DIFFTEST_TO_REF) {
+    memcpy(vm.mem + addr, buf, n);
+    patch_vpn = -1ull;
+  } else memcpy(buf, vm.mem + addr, n);
 }
 
 __EXPORT void difftest_regcpy(void *r, bool direction) {
@@ -382,6 +480,16 @@ __EXPORT void difftest_exec(uint64_t n) {
   kvm_exec(n);
 }
 
+__EXPORT int difftest_exec_until(word_t pc, uint64_t nr_hit) {
+  return kvm_exec_until(pc, nr_hit);
+}
+
+// The instructions which are patched in single-step mode must not be run in
+// a batch, DUT should end the batch right before them.
+__EXPORT int difftest_need_step(word_t pc) {
+  return need_patching(pc);
+}
+
 __EXPORT void difftest_raise_intr(word_t NO) {
   uint32_t pgate_vaddr = vcpu.kvm_run->s.regs.sregs.idt.base + NO * 8;
   uint32_t pgate = va2pa(pgate_vaddr);
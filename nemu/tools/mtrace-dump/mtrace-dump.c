@@ -0,0 +1,93 @@
+/***************************************************************************************
+* Copyright (c) 2014-2022 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+/* Print the memory trace written by NEMU with `--mtrace=FILE`, or the
+ * device trace written with `--dtrace=FILE`, as text, one access per line.
+ * The layouts of the records are MTraceRecord in include/memory/mtrace.h
+ * and DTraceRecord in src/device/io/map.c.
+ */
+
+#define MTRACE_MAGIC "NEMUMTR1"
+#define DTRACE_MAGIC "NEMUDTR1"
+#define MAX_MAP 256
+
+static uint64_t get_word(const uint8_t *p, int size) {
+  uint64_t x = 0;
+  int i;
+  for (i = size - 1; i >= 0; i --) x = (x << 8) | p[i];
+  return x;
+}
+
+// read the names of the maps ending with '\0'
+static int read_maps(FILE *fp, char names[][64]) {
+  int n = fgetc(fp), i, j, c;
+  for (i = 0; i < n; i ++) {
+    for (j = 0; (c = fgetc(fp)) != EOF && c != '\0'; j ++) {
+      if (j < 63) names[i][j] = c;
+    }
+    names[i][j < 63 ? j : 63] = '\0';
+    if (c == EOF) return -1;
+  }
+  return n;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 2) {
+    fprintf(stderr, "Usage: %s FILE\n", argv[0]);
+    return 1;
+  }
+  FILE *fp = fopen(argv[1], "rb");
+  if (fp == NULL) {
+    perror(argv[1]);
+    return 1;
+  }
+
+  char magic[sizeof(MTRACE_MAGIC) - 1];
+  static char names[MAX_MAP][64];
+  int nr_map = -1;
+  int size = fread(magic, sizeof(magic), 1, fp) == 1 ? fgetc(fp) : EOF;
+  bool is_dtrace = (memcmp(magic, DTRACE_MAGIC, sizeof(magic)) == 0);
+  if (is_dtrace) nr_map = read_maps(fp, names);
+  if ((!is_dtrace && memcmp(magic, MTRACE_MAGIC, sizeof(magic)) != 0) ||
+      (is_dtrace && nr_map < 0) || (size != 4 && size != 8)) {
+    fprintf(stderr, "%s is not a memory or device trace\n", argv[1]);
+    return 1;
+  }
+
+  static const char *type_name[] = { [1] = "read", [2] = "write", [4] = "fetch" };
+  uint8_t rec[8 * 3 + 2];
+  int rec_size = size * 3 + 1 + is_dtrace;
+  int w = size * 2;
+  while (fread(rec, rec_size, 1, fp) == 1) {
+    int len = rec[size * 3] & 0xf, type = rec[size * 3] >> 4;
+    printf("pc = 0x%0*" PRIx64 " %-5s addr = 0x%0*" PRIx64 " len = %d data = 0x%0*" PRIx64,
+        w, get_word(rec, size), (type < 5 && type_name[type] ? type_name[type] : "???"),
+        w, get_word(rec + size, size), len, len * 2, get_word(rec + size * 2, size));
+    if (is_dtrace) {
+      int map = rec[size * 3 + 1];
+      printf(" device = %s", (map < nr_map ? names[map] : "???"));
+    }
+    printf("\n");
+  }
+  fclose(fp);
+  return 0;
+}